@@ -1,42 +1,45 @@
-QT       += core gui serialport
+QT       += core gui serialport concurrent network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++11
 
+# Debug builds count heap allocations so the transfer loops can be checked,
+# see allocationcounter.h.  Left out of the library (capi/), which must not
+# replace the allocator of the program it is loaded into.
+CONFIG(debug, debug|release): DEFINES += HB_COUNT_ALLOCATIONS
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(engine.pri)
+
 SOURCES += \
     aboutdialog.cpp \
-    bootloader.cpp \
-    bootloaderusblink.cpp \
-    hexfile.cpp \
-    hidbootloader.cpp \
+    dashboard.cpp \
+    deviceservice.cpp \
     main.cpp \
     mainwindow.cpp \
-    uartbootloader.cpp \
+    sessionmodel.cpp \
+    simulatorserver.cpp \
+    throughputbenchmark.cpp \
     workerthread.cpp
 
 HEADERS += \
     aboutdialog.h \
-    bootloader.h \
-    bootloaderusblink.h \
-    hexfile.h \
-    hidbootloader.h \
+    dashboard.h \
+    deviceservice.h \
     mainwindow.h \
-    uartbootloader.h \
+    sessionmodel.h \
+    simulatorserver.h \
+    throughputbenchmark.h \
     workerthread.h
 
 FORMS += \
     aboutdialog.ui \
     mainwindow.ui
 
-LIBS += -lhid
-LIBS += -lsetupapi
-LIBS += -luser32
-
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
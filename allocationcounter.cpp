@@ -0,0 +1,222 @@
+#include "allocationcounter.h"
+#include <atomic>
+
+static std::atomic<qint64> s_violations(0);
+
+#ifdef HB_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+#include <errno.h>
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+#ifdef __GLIBC__
+//Counters live in the static TLS block so reaching them never allocates
+#define HB_THREAD_LOCAL static thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define HB_THREAD_LOCAL static thread_local
+#endif
+
+HB_THREAD_LOCAL qint64 t_allocations = 0;
+HB_THREAD_LOCAL int t_exempt = 0;
+
+static inline void countAllocation()
+{
+    if (t_exempt == 0) {
+        ++t_allocations;
+    }
+}
+
+#ifdef __GLIBC__
+//Qt containers allocate with malloc rather than operator new, so count
+//malloc itself.  glibc lets the executable interpose it and forward to the
+//real allocator, which also covers operator new.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+
+void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+//The aligned entry points do not go through malloc
+void *memalign(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    countAllocation();
+    void *mem = __libc_memalign(alignment, size);
+    if (!mem) {
+        return ENOMEM;
+    }
+    *ptr = mem;
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    countAllocation();
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size)
+{
+    countAllocation();
+    return __libc_pvalloc(size);
+}
+}
+#elif defined(_MSC_VER) && defined(_DEBUG)
+//The debug CRT calls a hook for every heap request, from malloc in Qt's
+//containers as well as operator new, on the thread making it
+static int __cdecl allocHook(int allocType, void *, size_t, int, long, const unsigned char *, int)
+{
+    if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC) {
+        countAllocation();
+    }
+    return 1;   //let the request go ahead
+}
+
+static const bool s_hookInstalled = (_CrtSetAllocHook(allocHook), true);
+#else
+//No way to see malloc here (MinGW, or a release CRT), so only operator new
+//is counted and Qt containers go unseen, see AllocationCounter::coversMalloc()
+void *operator new(size_t size)
+{
+    countAllocation();
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+bool AllocationCounter::enabled()
+{
+    return true;
+}
+
+bool AllocationCounter::coversMalloc()
+{
+#if defined(__GLIBC__) || (defined(_MSC_VER) && defined(_DEBUG))
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 AllocationCounter::count()
+{
+    return t_allocations;
+}
+
+AllocationExempt::AllocationExempt()
+{
+    ++t_exempt;
+}
+
+AllocationExempt::~AllocationExempt()
+{
+    --t_exempt;
+}
+
+#else
+
+bool AllocationCounter::enabled()
+{
+    return false;
+}
+
+bool AllocationCounter::coversMalloc()
+{
+    return false;
+}
+
+qint64 AllocationCounter::count()
+{
+    return 0;
+}
+
+AllocationExempt::AllocationExempt()
+{
+}
+
+AllocationExempt::~AllocationExempt()
+{
+}
+
+#endif
+
+qint64 AllocationCounter::violations()
+{
+    return s_violations;
+}
+
+void AllocationCounter::addViolations(qint64 allocations)
+{
+    s_violations += allocations;
+}
+
+NoAllocationScope::NoAllocationScope(const char *name)
+    : m_name(name), m_start(AllocationCounter::count()), m_ended(false)
+{
+}
+
+void NoAllocationScope::end()
+{
+    if (m_ended) {
+        return;
+    }
+    m_ended = true;
+    qint64 allocations = AllocationCounter::count() - m_start;
+    if (allocations > 0) {
+        AllocationCounter::addViolations(allocations);
+        qWarning("%s made %lld heap allocations", m_name, (long long)allocations);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+//Heap allocation accounting for the transfer loops.  Builds with
+//HB_COUNT_ALLOCATIONS defined (debug builds of the application) count the
+//allocations made on each thread: malloc and its relatives with glibc or the
+//MSVC debug CRT, only operator new elsewhere (MinGW).  Everywhere else
+//nothing is counted and the classes below do nothing.
+class AllocationCounter
+{
+public:
+    static bool enabled();
+    //False where only operator new is seen, so Qt containers are not counted
+    static bool coversMalloc();
+    //Allocations made by the calling thread so far
+    static qint64 count();
+    //Allocations found inside NoAllocationScopes on any thread
+    static qint64 violations();
+    static void addViolations(qint64 allocations);
+};
+
+//Marks a stretch of code that should not touch the heap, such as the
+//program and verify loops.  end() checks it and warns about, and adds to
+//violations(), any allocation made since construction.  Scopes left
+//without end(), as on the error paths, are not checked.
+class NoAllocationScope
+{
+public:
+    explicit NoAllocationScope(const char *name);
+    void end();
+private:
+    const char *m_name;
+    qint64 m_start;
+    bool m_ended;
+};
+
+//Allocations on this thread while one of these is alive are not counted.
+//For work that is not part of the path being checked, such as a simulated
+//device answering in-process.
+class AllocationExempt
+{
+public:
+    AllocationExempt();
+    ~AllocationExempt();
+    AllocationExempt(const AllocationExempt &) = delete;
+    AllocationExempt &operator=(const AllocationExempt &) = delete;
+};
+
+#endif // ALLOCATIONCOUNTER_H
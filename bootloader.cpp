@@ -1,6 +1,8 @@
 #include "bootloader.h"
+#include "crc.h"
+#include "allocationcounter.h"
 
-Bootloader::Bootloader() : m_abort(false)
+Bootloader::Bootloader() : m_family(OTHER), m_policy(&FamilyPolicy::forFamily(OTHER)), m_trace(nullptr)
 {
 
 }
@@ -17,8 +19,86 @@ bool Bootloader::eraseFlash()
     return true;
 }
 
+bool Bootloader::isUpToDate()
+{
+    //Override this if the device can be checked against the image
+    //without programming it.
+    return false;
+}
+
+QJsonObject Bootloader::linkInfo()
+{
+    //Transport details that change how a session is framed, kept in traces
+    return QJsonObject();
+}
+
+void Bootloader::setBlankCheck(uint32_t appStart, uint32_t length)
+{
+    //Only bootloaders with a separate erase step can skip it
+    (void) appStart;
+    (void) length;
+}
+
+void Bootloader::updateProgress(int &last, int percent)
+{
+    //Called per frame or block by the transfer loops.  A queued connection
+    //allocates an event for every emit, so only changes go out, at most 101
+    //a job, and those few are left out of the loops' allocation checks.
+    if (percent == last) {
+        return;
+    }
+    last = percent;
+    AllocationExempt signal;
+    emit progress(percent);
+}
+
 void Bootloader::abort()
 {
-    m_abort = true;
+    //Safe to call from any thread, wakes up transfers blocked on the device
+    m_cancel.cancel();
+}
+
+bool Bootloader::loadImage(QString fileNames, uint32_t eraseBlockSize, QString *error)
+{
+    //Several files separated by ';' are merged into a single image
+    //so they can be flashed in one session.
+    QStringList errors;
+    m_cachedImage = ImageCache::instance().get(fileNames, m_policy->physicalAddresses, eraseBlockSize, &errors);
+    if (!m_cachedImage) {
+        m_image.clear();
+        if (error) {
+            *error = errors.join("; ");
+        } else {
+            emit message(errors.join("; "));
+        }
+        return false;
+    }
+    m_image = m_cachedImage->image;
+    return true;
+}
+
+bool Bootloader::loadPagedImage(QString fileNames, uint32_t &flashStart, uint32_t eraseBlockSize, QByteArray &flashData)
+{
+    //Bin files load at the configured start address, hex files set their own
+    QStringList files = ImageBuilder::splitFileList(fileNames);
+    for (auto &i : files) {
+        if (i.endsWith(".bin", Qt::CaseInsensitive)) {
+            i += QString("@%1").arg(flashStart, 0, 16);
+        }
+    }
+    if (!loadImage(files.join(";"), eraseBlockSize)) {
+        return false;
+    }
+    flashStart = m_image.startAddress();
+    flashData = m_image.flatten(flashStart, eraseBlockSize);
+    return !flashData.isEmpty();
 }
 
+uint32_t Bootloader::pagedCRC32(const QByteArray &flashData, uint32_t eraseBlockSize)
+{
+    //flashData is already padded to whole erase blocks with 0xff
+    if (m_cachedImage && m_cachedImage->paddedCRC32.contains(eraseBlockSize)) {
+        return m_cachedImage->paddedCRC32.value(eraseBlockSize);
+    }
+    return CRC::crc32((const uint8_t *)flashData.constData(), flashData.size());
+}
@@ -2,6 +2,13 @@
 #define BOOTLOADER_H
 
 #include <QObject>
+#include <QJsonObject>
+#include "firmwareimage.h"
+#include "imagebuilder.h"
+#include "tracerecorder.h"
+#include "imagecache.h"
+#include "canceltoken.h"
+#include "familypolicy.h"
 
 class Bootloader : public QObject
 {
@@ -15,16 +22,38 @@ public:
     virtual bool programFlash() = 0;
     virtual void jumpToApp() = 0;
     virtual bool verify() = 0;
+    virtual bool isUpToDate();
+    virtual void setBlankCheck(uint32_t appStart, uint32_t length);
+    virtual QJsonObject linkInfo();
+    //Median command round trip of the last programming run in ms, 0 if not measured
+    virtual double roundTripMs() {return 0;}
+    //Bytes of image data loaded by setFile()
+    uint32_t imageSize() const {return m_image.dataSize();}
     virtual void abort();
-    bool isAborted() {return m_abort;}
+    bool isAborted() {return m_cancel.isCancelled();}
+    CancelToken &cancelToken() {return m_cancel;}
     enum {PIC32 = 0, ARM = 1, OTHER = 2};
-    void setFamily(int family) {m_family = family;}
+    void setFamily(int family) {m_family = family; m_policy = &FamilyPolicy::forFamily(family);}
+    void setTraceRecorder(TraceRecorder *trace) {m_trace = trace;}
 protected:
-    bool m_abort;
+    CancelToken m_cancel;
     int m_family;
+    const FamilyPolicy *m_policy;
+    TraceRecorder *m_trace;
+    FirmwareImage m_image;
+    std::shared_ptr<const CachedImage> m_cachedImage;
+    //Errors go to error when given (for callers off the job thread), to message otherwise
+    bool loadImage(QString fileNames, uint32_t eraseBlockSize = 0, QString *error = nullptr);
+    //Page based bootloaders (UART, CAN) program whole erase blocks from a flat copy
+    bool loadPagedImage(QString fileNames, uint32_t &flashStart, uint32_t eraseBlockSize, QByteArray &flashData);
+    uint32_t pagedCRC32(const QByteArray &flashData, uint32_t eraseBlockSize);
+    //Emits progress only when the percentage moves on from last
+    void updateProgress(int &last, int percent);
 signals:
     void finished(bool success);
     void progress(int p);
+    //"check", "erase", "program" or "verify", progress restarts at 0
+    void phaseStarted(QString name);
     void message(QString m);
 };
 
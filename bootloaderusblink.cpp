@@ -6,9 +6,14 @@ extern "C"
 #include <hidsdi.h>
 }
 #include <Dbt.h>
+#include "canceltoken.h"
 
 BootLoaderUSBLink::BootLoaderUSBLink()
-    : handle(INVALID_HANDLE_VALUE) {}
+    : handle(INVALID_HANDLE_VALUE),
+      ioEvent(NULL),
+      inputReportLength(DEFAULT_REPORT_SIZE + 1),
+      outputReportLength(DEFAULT_REPORT_SIZE + 1),
+      report(DEFAULT_REPORT_SIZE + 1) {}
 
 BootLoaderUSBLink::~BootLoaderUSBLink() { closeHandles(); }
 
@@ -64,85 +69,108 @@ void BootLoaderUSBLink::Open(uint16_t pid, uint16_t vid) {
   if (deviceInfo != INVALID_HANDLE_VALUE) {
     SetupDiDestroyDeviceInfoList(deviceInfo);
   }
+  if (handle != INVALID_HANDLE_VALUE) {
+    readCaps();
+    // One event for every overlapped read and write on this handle, they
+    // are never outstanding at the same time
+    if (!ioEvent) {
+      ioEvent = CreateEvent((LPSECURITY_ATTRIBUTES)NULL, FALSE, TRUE, NULL);
+    }
+  }
+}
+
+void BootLoaderUSBLink::readCaps(void) {
+  // Report lengths include the report ID byte.  High speed bootloaders
+  // can use up to 1024 byte reports.
+  PHIDP_PREPARSED_DATA preparsedData;
+  HIDP_CAPS caps;
+  inputReportLength = DEFAULT_REPORT_SIZE + 1;
+  outputReportLength = DEFAULT_REPORT_SIZE + 1;
+  if (HidD_GetPreparsedData(handle, &preparsedData)) {
+    if (HidP_GetCaps(preparsedData, &caps) == HIDP_STATUS_SUCCESS) {
+      inputReportLength = qBound(2, (int)caps.InputReportByteLength,
+                                 MAX_REPORT_SIZE + 1);
+      outputReportLength = qBound(2, (int)caps.OutputReportByteLength,
+                                  MAX_REPORT_SIZE + 1);
+    }
+    HidD_FreePreparsedData(preparsedData);
+  }
+  report.resize(qMax(inputReportLength, outputReportLength));
+}
+
+// Waits for an overlapped request, ending early if the cancel token fires.
+// On timeout or cancel the request is cancelled and waited for, so the
+// driver is done with the report buffer before it is reused.
+static bool waitIo(HANDLE handle, OVERLAPPED *overlapped, CancelToken *cancel,
+                   int wait_ms) {
+  HANDLE events[2] = {overlapped->hEvent,
+                      cancel ? (HANDLE)cancel->waitHandle() : NULL};
+  DWORD count = events[1] ? 2 : 1;
+  DWORD len;
+  if (cancel && cancel->isCancelled()) {
+    CancelIo(handle);
+    GetOverlappedResult(handle, overlapped, &len, TRUE);
+    return false;
+  }
+  DWORD status = WaitForMultipleObjects(count, events, FALSE, wait_ms);
+  if (status == WAIT_OBJECT_0) {
+    return true;
+  }
+  // Timeout, cancel or undefined error
+  CancelIo(handle);
+  GetOverlappedResult(handle, overlapped, &len, TRUE);
+  return false;
 }
 
 bool BootLoaderUSBLink::WriteDevice(uint8_t *buffer, int len, int wait_ms) {
   DWORD actualLen;
   int status;
-  HANDLE hEventObject;
   OVERLAPPED HIDOverlapped;
-  uint8_t report[65];
+  int payload = outputReportLength - 1;
 
   if (handle == INVALID_HANDLE_VALUE) {
     return false;
   }
-  hEventObject = CreateEvent((LPSECURITY_ATTRIBUTES)NULL, FALSE, TRUE, L"");
-  HIDOverlapped.hEvent = hEventObject;
+  HIDOverlapped.hEvent = ioEvent;
 
   do {
     HIDOverlapped.Offset = 0;
     HIDOverlapped.OffsetHigh = 0;
     report[0] = 0;
-    memcpy(&report[1], buffer, 64);
-    status = WriteFile(handle, report, 65, &actualLen, &HIDOverlapped);
+    memcpy(&report[1], buffer, qMin(len, payload));
+    if (len < payload) {
+      memset(&report[1 + len], 0, payload - len);
+    }
+    status = WriteFile(handle, report.data(), outputReportLength, &actualLen,
+                       &HIDOverlapped);
     (void) status;
-    status = WaitForSingleObject(hEventObject, wait_ms);
-    switch (status) {
-      case WAIT_OBJECT_0:
-        // Success;
-        break;
-      case WAIT_TIMEOUT:
-        // Timeout error;
-        // Cancel the read operation.
-        CancelIo(handle);
-        return false;
-      default:
-        // Undefined error;
-        // Cancel the read operation.
-        CancelIo(handle);
-        return false;
+    if (!waitIo(handle, &HIDOverlapped, m_cancel, wait_ms)) {
+      return false;
     }
-    len -= 64;
-    buffer += 64;
+    len -= payload;
+    buffer += payload;
   } while (len > 0);
   return true;
 }
 
 bool BootLoaderUSBLink::ReadDevice(uint8_t *buffer, int wait_ms) {
   DWORD len;
-  int status;
-  HANDLE hEventObject;
   OVERLAPPED HIDOverlapped;
-  uint8_t report[65];
 
   if (handle == INVALID_HANDLE_VALUE) {
     return false;
   }
-  hEventObject = CreateEvent((LPSECURITY_ATTRIBUTES)NULL, FALSE, TRUE, L"");
-  HIDOverlapped.hEvent = hEventObject;
+  HIDOverlapped.hEvent = ioEvent;
   HIDOverlapped.Offset = 0;
   HIDOverlapped.OffsetHigh = 0;
   report[0] = 0;
-  ReadFile(handle, report, 65, &len, &HIDOverlapped);
-  status = WaitForSingleObject(hEventObject, wait_ms);
-  switch (status) {
-    case WAIT_OBJECT_0:
-      // Success;
-      // Use the report data;
-      memcpy(buffer, &report[1], 64);
-      return true;
-    case WAIT_TIMEOUT:
-      // Timeout error;
-      // Cancel the read operation.
-      CancelIo(handle);
-      break;
-    default:
-      // Undefined error;
-      // Cancel the read operation.
-      CancelIo(handle);
-      break;
+  ReadFile(handle, report.data(), inputReportLength, &len, &HIDOverlapped);
+  if (!waitIo(handle, &HIDOverlapped, m_cancel, wait_ms)) {
+    return false;
   }
-  return false;
+  // Use the report data
+  memcpy(buffer, &report[1], inputReportLength - 1);
+  return true;
 }
 
 bool BootLoaderUSBLink::Connected(void) {
@@ -156,6 +184,10 @@ void BootLoaderUSBLink::closeHandles(void) {
     CloseHandle(handle);
     handle = INVALID_HANDLE_VALUE;
   }
+  if (ioEvent) {
+    CloseHandle(ioEvent);
+    ioEvent = NULL;
+  }
 }
 
 QString BootLoaderUSBLink::getDevicePath() const { return devicePath; }
@@ -3,10 +3,12 @@
 
 #include <stdint.h>
 #include <QString>
+#include <vector>
+#include "hidlink.h"
 
 #define MY_VID             0x4d63
 
-class BootLoaderUSBLink
+class BootLoaderUSBLink : public HidLink
 {
 public:
     BootLoaderUSBLink();
@@ -14,13 +16,25 @@ public:
     ~BootLoaderUSBLink();
     BootLoaderUSBLink& operator=(const BootLoaderUSBLink &obj) = delete;
     void Open(uint16_t pid, uint16_t vid = MY_VID);
-    bool WriteDevice(uint8_t *buffer, int len, int wait_ms = 200);
-    bool ReadDevice(uint8_t *buffer, int wait_ms = 200);
-	bool Connected(void);
-	void Close(void);
+    virtual bool WriteDevice(uint8_t *buffer, int len, int wait_ms = 200) override;
+    virtual bool ReadDevice(uint8_t *buffer, int wait_ms = 200) override;
+    virtual bool Connected(void) override;
+    virtual void Close(void) override;
+    virtual int inputReportSize(void) override { return inputReportLength - 1; }
+    virtual int outputReportSize(void) override { return outputReportLength - 1; }
     QString getDevicePath() const;
 private:
+#ifdef Q_OS_WIN
     void *handle;
+    void *ioEvent;      // overlapped I/O completion, created with the handle
+#else
+    int fd;             // /dev/hidrawN, see bootloaderusblink_linux.cpp
+    bool waitFd(short events, int wait_ms);
+#endif
+    int inputReportLength;
+    int outputReportLength;
+    std::vector<uint8_t> report;
+    void readCaps(void);
     void closeHandles(void);
     QString devicePath;
 };
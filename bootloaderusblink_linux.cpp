@@ -0,0 +1,191 @@
+#include "bootloaderusblink.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/hidraw.h>
+#include "canceltoken.h"
+
+// hidraw counterpart of the SetupAPI link in bootloaderusblink.cpp.  Reports
+// go through /dev/hidrawN, which needs read/write access to the node (a udev
+// rule for the bootloader's VID/PID).
+
+BootLoaderUSBLink::BootLoaderUSBLink()
+    : fd(-1),
+      inputReportLength(DEFAULT_REPORT_SIZE + 1),
+      outputReportLength(DEFAULT_REPORT_SIZE + 1),
+      report(DEFAULT_REPORT_SIZE + 1) {}
+
+BootLoaderUSBLink::~BootLoaderUSBLink() { closeHandles(); }
+
+void BootLoaderUSBLink::Open(uint16_t pid, uint16_t vid) {
+  devicePath = "";
+  closeHandles();
+  QStringList nodes =
+      QDir("/dev").entryList(QStringList("hidraw*"), QDir::System, QDir::Name);
+  for (auto &i : nodes) {
+    QString path = "/dev/" + i;
+    int hidDevice =
+        open(QFile::encodeName(path).constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (hidDevice < 0) {
+      continue;
+    }
+    struct hidraw_devinfo info;
+    if (ioctl(hidDevice, HIDIOCGRAWINFO, &info) == 0 &&
+        (uint16_t)info.vendor == vid && (uint16_t)info.product == pid) {
+      fd = hidDevice;
+      devicePath = path;
+      break;
+    }
+    close(hidDevice);
+  }
+  if (fd >= 0) {
+    readCaps();
+  }
+}
+
+void BootLoaderUSBLink::readCaps(void) {
+  // Report lengths include the report ID byte, as on Windows.  hidraw has no
+  // caps call, so the Report Size and Report Count of the Input and Output
+  // items in the report descriptor are added up.
+  inputReportLength = DEFAULT_REPORT_SIZE + 1;
+  outputReportLength = DEFAULT_REPORT_SIZE + 1;
+  int descSize = 0;
+  struct hidraw_report_descriptor desc;
+  if (ioctl(fd, HIDIOCGRDESCSIZE, &descSize) == 0 && descSize > 0) {
+    desc.size = descSize;
+    if (ioctl(fd, HIDIOCGRDESC, &desc) == 0) {
+      uint32_t size = 0;
+      uint32_t count = 0;
+      uint32_t inBits = 0;
+      uint32_t outBits = 0;
+      for (uint32_t i = 0; i < desc.size;) {
+        uint8_t prefix = desc.value[i];
+        if (prefix == 0xfe) {
+          // Long item, never used for sizes
+          i += 3 + (i + 1 < desc.size ? desc.value[i + 1] : 0);
+          continue;
+        }
+        int n = (prefix & 3) == 3 ? 4 : prefix & 3;
+        uint32_t value = 0;
+        for (int j = 0; j < n && i + 1 + j < desc.size; ++j) {
+          value |= (uint32_t)desc.value[i + 1 + j] << (8 * j);
+        }
+        switch (prefix & 0xfc) {
+        case 0x74:  // Report Size
+          size = value;
+          break;
+        case 0x94:  // Report Count
+          count = value;
+          break;
+        case 0x80:  // Input
+          inBits += size * count;
+          break;
+        case 0x90:  // Output
+          outBits += size * count;
+          break;
+        }
+        i += 1 + n;
+      }
+      if (inBits > 0) {
+        inputReportLength = qBound(2, (int)(inBits / 8) + 1, MAX_REPORT_SIZE + 1);
+      }
+      if (outBits > 0) {
+        outputReportLength = qBound(2, (int)(outBits / 8) + 1, MAX_REPORT_SIZE + 1);
+      }
+    }
+  }
+  report.resize(qMax(inputReportLength, outputReportLength));
+}
+
+// Waits for the node to be readable or writable, in slices so a cancel ends
+// the wait within a few milliseconds.
+bool BootLoaderUSBLink::waitFd(short events, int wait_ms) {
+  QElapsedTimer timer;
+  timer.start();
+  struct pollfd fds = {fd, events, 0};
+  for (;;) {
+    if (m_cancel && m_cancel->isCancelled()) {
+      return false;
+    }
+    int remaining = wait_ms - timer.elapsed();
+    if (remaining < 0) {
+      return false;
+    }
+    int ret = poll(&fds, 1,
+                   m_cancel ? qMin(remaining, (int)CancelToken::POLL_SLICE_MS)
+                            : remaining);
+    if (ret > 0) {
+      return (fds.revents & events) != 0;
+    }
+    if (ret < 0 && errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool BootLoaderUSBLink::WriteDevice(uint8_t *buffer, int len, int wait_ms) {
+  int payload = outputReportLength - 1;
+
+  if (fd < 0) {
+    return false;
+  }
+  do {
+    // Report ID 0 is dropped by hidraw for devices without numbered reports
+    report[0] = 0;
+    memcpy(&report[1], buffer, qMin(len, payload));
+    if (len < payload) {
+      memset(&report[1 + len], 0, payload - len);
+    }
+    for (;;) {
+      ssize_t written = write(fd, report.data(), outputReportLength);
+      if (written == outputReportLength) {
+        break;
+      }
+      if (written >= 0 || (errno != EAGAIN && errno != EINTR) ||
+          !waitFd(POLLOUT, wait_ms)) {
+        return false;
+      }
+    }
+    len -= payload;
+    buffer += payload;
+  } while (len > 0);
+  return true;
+}
+
+bool BootLoaderUSBLink::ReadDevice(uint8_t *buffer, int wait_ms) {
+  if (fd < 0) {
+    return false;
+  }
+  if (!waitFd(POLLIN, wait_ms)) {
+    return false;
+  }
+  ssize_t len = read(fd, &report[1], inputReportLength - 1);
+  if (len <= 0) {
+    return false;
+  }
+  // Short reports are padded the way the Windows driver returns them
+  if (len < inputReportLength - 1) {
+    memset(&report[1 + len], 0, inputReportLength - 1 - len);
+  }
+  memcpy(buffer, &report[1], inputReportLength - 1);
+  return true;
+}
+
+bool BootLoaderUSBLink::Connected(void) { return fd >= 0; }
+
+void BootLoaderUSBLink::Close(void) { closeHandles(); }
+
+void BootLoaderUSBLink::closeHandles(void) {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+QString BootLoaderUSBLink::getDevicePath() const { return devicePath; }
@@ -0,0 +1,208 @@
+#include "boottrigger.h"
+#include "bootloaderusblink.h"
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QStringList>
+#include <QThread>
+#include <QtSerialPort/QSerialPort>
+#include <QtSerialPort/QSerialPortInfo>
+
+BootTrigger::BootTrigger()
+{
+
+}
+
+TriggerResult BootTrigger::run(const QJsonObject &profile, const QJsonObject &target)
+{
+    m_steps.clear();
+    m_error.clear();
+    //Network bridges and CAN cannot be watched, the steps and settle time are all there is
+    bool observable = target["connection"].toString() == "USB"
+            || (target["connection"].toString() == "UART" && !target["port"].toString().startsWith("tcp://"));
+    bool reenumerates = observable && profile["re-enumerates"].toBool(true);
+    //A bootloader with the same ids as the application, or a port that is
+    //there throughout, has only restarted once it has gone away first
+    bool wasPresent = reenumerates && isPresent(target);
+    QElapsedTimer timer;
+    for (auto &&i : profile["steps"].toArray()) {
+        QJsonObject step = i.toObject();
+        timer.start();
+        if (!runStep(step, target)) {
+            return {false, QString("%1 failed: %2").arg(step["type"].toString(), m_error)};
+        }
+        m_steps.append({step["type"].toString(), timer.nsecsElapsed() / 1e6});
+    }
+    int waitMs = profile["wait ms"].toInt(DEFAULT_WAIT_MS);
+    QElapsedTimer waitTimer;
+    waitTimer.start();
+    if (reenumerates) {
+        if (wasPresent) {
+            timer.start();
+            if (!waitFor(target, false, waitMs)) {
+                return {false, QString("Device did not restart within %1 ms").arg(waitMs)};
+            }
+            m_steps.append({"device gone", timer.nsecsElapsed() / 1e6});
+        }
+        timer.start();
+        if (!waitFor(target, true, waitMs - waitTimer.elapsed())) {
+            return {false, QString("Bootloader did not appear within %1 ms").arg(waitMs)};
+        }
+        m_steps.append({"bootloader present", timer.nsecsElapsed() / 1e6});
+    }
+    int settleMs = profile["settle ms"].toInt(0);
+    if (settleMs > 0) {
+        timer.start();
+        QThread::msleep(settleMs);
+        m_steps.append({"settle", timer.nsecsElapsed() / 1e6});
+    }
+    return {true, report()};
+}
+
+bool BootTrigger::runStep(const QJsonObject &step, const QJsonObject &target)
+{
+    QString type = step["type"].toString();
+    QString portName = step.contains("port") ? step["port"].toString() : target["port"].toString();
+    if (type == "hid report") {
+        return hidReport(step);
+    } else if (type == "baud touch") {
+        return baudTouch(step, portName);
+    } else if (type == "lines") {
+        return lines(step, portName);
+    } else if (type == "magic") {
+        return magic(step, portName, target["baud"].toInt(115200));
+    } else if (type == "delay") {
+        QThread::msleep(step["ms"].toInt());
+        return true;
+    }
+    m_error = "unknown step type";
+    return false;
+}
+
+bool BootTrigger::hidReport(const QJsonObject &step)
+{
+    bool ok;
+    uint16_t vid = step["vid"].toString().toUShort(&ok, 16);
+    uint16_t pid = ok ? step["pid"].toString().toUShort(&ok, 16) : 0;
+    if (!ok) {
+        m_error = "invalid vid/pid";
+        return false;
+    }
+    QByteArray report = parseBytes(step["report"].toString());
+    BootLoaderUSBLink link;
+    link.Open(pid, vid);
+    if (!link.Connected()) {
+        m_error = QString("no application with vid=%1, pid=%2").arg(vid, 4, 16, QChar('0')).arg(pid, 4, 16, QChar('0'));
+        return false;
+    }
+    bool sent = link.WriteDevice((uint8_t *)report.data(), report.size(), 500);
+    link.Close();
+    if (!sent) {
+        m_error = "report not accepted";
+    }
+    return sent;
+}
+
+bool BootTrigger::baudTouch(const QJsonObject &step, QString portName)
+{
+    //Opening at the magic rate and dropping DTR is what the application
+    //watches for (the Arduino convention)
+    QSerialPort port(portName);
+    port.setBaudRate(step["baud"].toInt(1200));
+    if (!port.open(QIODevice::ReadWrite)) {
+        m_error = port.errorString();
+        return false;
+    }
+    port.setDataTerminalReady(false);
+    port.close();
+    return true;
+}
+
+bool BootTrigger::lines(const QJsonObject &step, QString portName)
+{
+    QSerialPort port(portName);
+    if (!port.open(QIODevice::ReadWrite)) {
+        m_error = port.errorString();
+        return false;
+    }
+    for (auto &&i : step["sequence"].toArray()) {
+        QJsonObject state = i.toObject();
+        port.setDataTerminalReady(state["dtr"].toBool(false));
+        port.setRequestToSend(state["rts"].toBool(false));
+        if (state["ms"].toInt() > 0) {
+            QThread::msleep(state["ms"].toInt());
+        }
+    }
+    port.close();
+    return true;
+}
+
+bool BootTrigger::magic(const QJsonObject &step, QString portName, int baud)
+{
+    QByteArray bytes = parseBytes(step["bytes"].toString());
+    QSerialPort port(portName);
+    port.setBaudRate(step["baud"].toInt(baud));
+    if (!port.open(QIODevice::ReadWrite)) {
+        m_error = port.errorString();
+        return false;
+    }
+    port.write(bytes);
+    bool written = port.waitForBytesWritten(1000);
+    port.close();
+    if (!written) {
+        m_error = "write timed out";
+    }
+    return written;
+}
+
+bool BootTrigger::waitFor(const QJsonObject &target, bool present, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (;;) {
+        if (isPresent(target) == present) {
+            return true;
+        }
+        if (timer.elapsed() >= timeoutMs) {
+            return false;
+        }
+        QThread::msleep(POLL_MS);
+    }
+}
+
+bool BootTrigger::isPresent(const QJsonObject &target)
+{
+    if (target["connection"].toString() == "USB") {
+        bool ok;
+        uint16_t vid = target["vid"].toString().toUShort(&ok, 16);
+        uint16_t pid = target["pid"].toString().toUShort(&ok, 16);
+        BootLoaderUSBLink link;
+        link.Open(pid, vid);
+        bool connected = link.Connected();
+        link.Close();
+        return connected;
+    }
+    QString portName = target["port"].toString();
+    for (auto &&i : QSerialPortInfo::availablePorts()) {
+        if (i.portName() == portName || i.systemLocation() == portName) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString BootTrigger::report() const
+{
+    QStringList parts;
+    double total = 0;
+    for (auto &i : m_steps) {
+        parts.append(QString("%1 %2 ms").arg(i.name).arg(i.ms, 0, 'f', 1));
+        total += i.ms;
+    }
+    return QString("Bootloader entry %1 ms (%2)").arg(total, 0, 'f', 1).arg(parts.join(", "));
+}
+
+QByteArray BootTrigger::parseBytes(QString hex)
+{
+    //Spaces or other separators between the bytes are ignored
+    return QByteArray::fromHex(hex.toLatin1());
+}
@@ -0,0 +1,54 @@
+#ifndef BOOTTRIGGER_H
+#define BOOTTRIGGER_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+typedef struct {
+    QString name;
+    double ms;
+} TriggerStep;
+
+typedef struct {
+    bool success;
+    QString report;         //step timings, or what went wrong
+} TriggerResult;
+
+//Asks a running application to restart into its bootloader and waits for
+//the bootloader to appear, so boards need no button pressing.  Profiles come
+//from the "triggers" array of devices.json: a "name", a list of "steps" and
+//optionally "re-enumerates" (default true), "wait ms" (default 5000) and
+//"settle ms" (default 0).  Steps ("type"):
+//  hid report  "report" (hex bytes) to the application's "vid"/"pid"
+//  baud touch  open the port at "baud" (default 1200) and close it with DTR low
+//  lines       DTR/RTS states from "sequence", each {"dtr", "rts", "ms"}
+//  magic       write "bytes" (hex) at "baud" (default the target's)
+//  delay       "ms"
+//Serial steps use their own "port" or the target's.  Every step is timed,
+//and so is the wait for the bootloader.
+class BootTrigger
+{
+public:
+    BootTrigger();
+    //target is what gets opened afterwards: "connection" USB with "vid" and
+    //"pid", or UART with "port" and "baud".  Blocks until the bootloader is
+    //there or the wait times out.
+    TriggerResult run(const QJsonObject &profile, const QJsonObject &target);
+    const QList<TriggerStep> &steps() const {return m_steps;}
+private:
+    enum {POLL_MS = 50, DEFAULT_WAIT_MS = 5000};
+    QList<TriggerStep> m_steps;
+    QString m_error;
+    bool runStep(const QJsonObject &step, const QJsonObject &target);
+    bool hidReport(const QJsonObject &step);
+    bool baudTouch(const QJsonObject &step, QString portName);
+    bool lines(const QJsonObject &step, QString portName);
+    bool magic(const QJsonObject &step, QString portName, int baud);
+    bool waitFor(const QJsonObject &target, bool present, int timeoutMs);
+    static bool isPresent(const QJsonObject &target);
+    QString report() const;
+    static QByteArray parseBytes(QString hex);
+};
+
+#endif // BOOTTRIGGER_H
@@ -0,0 +1,172 @@
+#include "canbootloader.h"
+#include "allocationcounter.h"
+
+CANBootloader::CANBootloader(QString interface, bool canFd, uint32_t startAddress, uint16_t eraseBlockSize,
+                             uint32_t baseId) :
+    Bootloader(), m_interface(interface), m_baseId(baseId), m_flashStart(startAddress),
+    m_eraseBlockSize(eraseBlockSize), m_flashCRC(0xffffffff)
+{
+    if (!m_socket.open(interface, canFd, QList<uint32_t>() << baseId + 2)) {
+        emit message(m_socket.errorString());
+    }
+}
+
+bool CANBootloader::isConnected()
+{
+    return m_socket.isOpen();
+}
+
+int CANBootloader::readBootInfo()
+{
+    uint8_t command = BL_CMD_READ_VERSION;
+    CanFrame reply;
+    if (!sendCommand(&command, 1) || !readResponse(reply, 200) || reply.len < 3
+            || reply.data[0] != BL_RESP_OK) {
+        return 0;
+    }
+    return (reply.data[1] << 8) + reply.data[2];
+}
+
+bool CANBootloader::setFile(QString fileName)
+{
+    return loadPagedImage(fileName, m_flashStart, m_eraseBlockSize, m_flashData);
+}
+
+bool CANBootloader::programFlash()
+{
+    emit message("Programming flash");
+    m_flashCRC = pagedCRC32(m_flashData, m_eraseBlockSize);
+    uint32_t flashLen = m_flashData.size();
+    int blocks = flashLen / m_eraseBlockSize;
+    uint8_t unlock[8] = {BL_CMD_UNLOCK,
+                         (uint8_t)m_flashStart, (uint8_t)(m_flashStart >> 8),
+                         (uint8_t)(m_flashStart >> 16), (uint8_t)(m_flashStart >> 24),
+                         (uint8_t)flashLen, (uint8_t)(flashLen >> 8), (uint8_t)(flashLen >> 16)};
+    CanFrame reply;
+    if (flashLen > 0xffffff || !sendCommand(unlock, 8) || !readResponse(reply)
+            || reply.data[0] != BL_RESP_OK) {
+        emit finished(false);
+        return false;
+    }
+    int percent = -1;
+    NoAllocationScope steady("CAN program loop");
+    for (int block = 0; block < blocks; ++block) {
+        if (m_cancel.isCancelled()) {
+            emit finished(false);
+            return false;
+        }
+        if (!sendBlock(m_flashStart + block * m_eraseBlockSize,
+                       (const uint8_t *)m_flashData.constData() + block * m_eraseBlockSize, m_eraseBlockSize)) {
+            emit finished(false);
+            return false;
+        }
+        updateProgress(percent, (block + 1) * 100 / blocks);
+    }
+    steady.end();
+    return true;
+}
+
+bool CANBootloader::sendBlock(uint32_t address, const uint8_t *data, int len)
+{
+    uint8_t command[7] = {BL_CMD_DATA, (uint8_t)address, (uint8_t)(address >> 8),
+                          (uint8_t)(address >> 16), (uint8_t)(address >> 24),
+                          (uint8_t)len, (uint8_t)(len >> 8)};
+    if (!sendCommand(command, 7)) {
+        return false;
+    }
+    int chunk = m_socket.maxPayload() - 1;
+    int frames = (len + chunk - 1) / chunk;
+    int sent = 0;
+    int acked = 0;
+    CanFrame batch[WINDOW];
+    CanFrame reply;
+    for (;;) {
+        //Fill the window in one batch, then wait for the next ack
+        int count = 0;
+        while (sent < frames && sent - acked < WINDOW) {
+            CanFrame &frame = batch[count++];
+            int offset = sent * chunk;
+            int frameLen = qMin(chunk, len - offset);
+            frame.id = m_baseId + 1;
+            frame.len = frameLen + 1;
+            frame.data[0] = (uint8_t)sent;
+            memcpy(&frame.data[1], data + offset, frameLen);
+            ++sent;
+        }
+        if (count > 0 && !m_socket.send(batch, count)) {
+            emit message(m_socket.errorString());
+            return false;
+        }
+        //The last reply of a block waits for the node to program it
+        if (!readResponse(reply, sent == frames ? (int)BLOCK_TIMEOUT : 1000)) {
+            emit message(QString("No reply from node at block 0x%1").arg(address, 0, 16));
+            return false;
+        }
+        if (reply.data[0] == BL_RESP_ACK && reply.len >= 2) {
+            //Ack carries the low 8 bits of the last frame received
+            int advance = (uint8_t)(reply.data[1] - (uint8_t)acked) + 1;
+            if (advance <= sent - acked) {
+                acked += advance;
+            }
+            continue;
+        }
+        return reply.data[0] == BL_RESP_OK && sent == frames;
+    }
+}
+
+void CANBootloader::jumpToApp()
+{
+    uint8_t command = BL_CMD_RESET;
+    CanFrame reply;
+    if (!sendCommand(&command, 1) || !readResponse(reply)) {
+        emit finished(false);
+        return;
+    }
+    emit finished(true);
+}
+
+bool CANBootloader::verify()
+{
+    uint8_t command[5] = {BL_CMD_VERIFY, (uint8_t)m_flashCRC, (uint8_t)(m_flashCRC >> 8),
+                          (uint8_t)(m_flashCRC >> 16), (uint8_t)(m_flashCRC >> 24)};
+    CanFrame reply;
+    if (!sendCommand(command, 5) || !readResponse(reply)) {
+        return false;
+    }
+    if (reply.data[0] != BL_RESP_CRC_OK) {
+        emit message("Flash verify failed");
+        return false;
+    }
+    emit message("Flash verified");
+    return true;
+}
+
+bool CANBootloader::sendCommand(const uint8_t *data, int len)
+{
+    if (m_cancel.isCancelled()) {
+        return false;
+    }
+    CanFrame frame;
+    frame.id = m_baseId;
+    frame.len = len;
+    memcpy(frame.data, data, len);
+    if (m_trace) {
+        m_trace->record(TraceRecorder::TX, data, len);
+    }
+    if (!m_socket.send(&frame, 1)) {
+        emit message(m_socket.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool CANBootloader::readResponse(CanFrame &frame, int wait_ms)
+{
+    if (m_socket.receive(&frame, 1, wait_ms, &m_cancel) != 1 || frame.len < 1) {
+        return false;
+    }
+    if (m_trace) {
+        m_trace->record(TraceRecorder::RX, frame.data, frame.len);
+    }
+    return true;
+}
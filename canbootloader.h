@@ -0,0 +1,56 @@
+#ifndef CANBOOTLOADER_H
+#define CANBOOTLOADER_H
+
+#include "bootloader.h"
+#include "cansocket.h"
+#include <QByteArray>
+
+//Harmony command set (same codes as the UART bootloader) carried over CAN.
+//All integers are little endian, identifiers are 11 bit.
+//
+//  base id     host commands  UNLOCK      a0 start[4] size[3]
+//                             DATA        a1 address[4] length[2]
+//                             VERIFY      a2 crc32[4]
+//                             RESET       a3
+//                             READ_VERSION a6
+//  base id + 1 host data      seq[1] up to 7 (CAN) or 63 (CAN-FD) bytes of
+//                             the current DATA block, seq counts from 0
+//  base id + 2 node replies   code[1] [args]
+//                             ACK 55 seq[1] every ACK_INTERVAL data frames,
+//                             acknowledges everything up to seq
+//                             OK 50 once a block is received and programmed,
+//                             ERROR 51, CRC_OK 53, CRC_FAIL 54,
+//                             READ_VERSION replies 50 major minor
+//
+//The host keeps at most WINDOW data frames unacknowledged, which is what the
+//node must be able to queue, and otherwise sends back to back.
+class CANBootloader : public Bootloader
+{
+public:
+    CANBootloader(QString interface, bool canFd, uint32_t startAddress, uint16_t eraseBlockSize,
+                  uint32_t baseId = DEFAULT_BASE_ID);
+    virtual bool isConnected() override;
+    virtual int readBootInfo() override;
+    virtual bool setFile(QString fileName) override;
+    virtual bool programFlash() override;
+    virtual void jumpToApp() override;
+    virtual bool verify() override;
+    enum {DEFAULT_BASE_ID = 0x600, WINDOW = 32, ACK_INTERVAL = 8, BLOCK_TIMEOUT = 5000};
+    enum {BL_CMD_UNLOCK = 0xa0, BL_CMD_DATA = 0xa1, BL_CMD_VERIFY = 0xa2, BL_CMD_RESET = 0xa3,
+          BL_CMD_READ_VERSION = 0xa6};
+    enum {BL_RESP_OK = 0x50, BL_RESP_ERROR = 0x51, BL_RESP_CRC_OK = 0x53, BL_RESP_CRC_FAIL = 0x54,
+          BL_RESP_ACK = 0x55};
+private:
+    QString m_interface;
+    uint32_t m_baseId;
+    uint32_t m_flashStart;
+    uint16_t m_eraseBlockSize;
+    uint32_t m_flashCRC;
+    QByteArray m_flashData;
+    CanSocket m_socket;
+    bool sendCommand(const uint8_t *data, int len);
+    bool readResponse(CanFrame &frame, int wait_ms = 1000);
+    bool sendBlock(uint32_t address, const uint8_t *data, int len);
+};
+
+#endif // CANBOOTLOADER_H
@@ -0,0 +1,69 @@
+#include "canceltoken.h"
+#ifdef Q_OS_WIN
+#include <Windows.h>
+#endif
+
+CancelToken::CancelToken() : m_cancelled(false), m_cancelTime(-1), m_event(nullptr)
+{
+    m_clock.start();
+#ifdef Q_OS_WIN
+    m_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+#endif
+}
+
+CancelToken::~CancelToken()
+{
+#ifdef Q_OS_WIN
+    if (m_event) {
+        CloseHandle(m_event);
+    }
+#endif
+}
+
+void CancelToken::cancel()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_cancelled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    m_cancelTime.store(m_clock.nsecsElapsed(), std::memory_order_relaxed);
+    m_cancelled.store(true, std::memory_order_release);
+#ifdef Q_OS_WIN
+    SetEvent(m_event);
+#endif
+    m_wake.wakeAll();
+}
+
+void CancelToken::reset()
+{
+    QMutexLocker lock(&m_mutex);
+    m_cancelled.store(false, std::memory_order_release);
+    m_cancelTime.store(-1, std::memory_order_relaxed);
+#ifdef Q_OS_WIN
+    ResetEvent(m_event);
+#endif
+}
+
+bool CancelToken::sleep(int msecs)
+{
+    QMutexLocker lock(&m_mutex);
+    QElapsedTimer timer;
+    timer.start();
+    while (!isCancelled()) {
+        qint64 remaining = msecs - timer.elapsed();
+        if (remaining <= 0) {
+            return true;
+        }
+        m_wake.wait(&m_mutex, (unsigned long)remaining);
+    }
+    return false;
+}
+
+qint64 CancelToken::msSinceCancel() const
+{
+    qint64 cancelTime = m_cancelTime.load(std::memory_order_relaxed);
+    if (!isCancelled() || cancelTime < 0) {
+        return -1;
+    }
+    return (m_clock.nsecsElapsed() - cancelTime) / 1000000;
+}
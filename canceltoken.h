@@ -0,0 +1,37 @@
+#ifndef CANCELTOKEN_H
+#define CANCELTOKEN_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <atomic>
+
+//Cancellation flag shared between the GUI and a running job.  Besides the
+//flag it carries a wakeup handle so blocked waits end as soon as cancel() is
+//called instead of running into their timeout.
+class CancelToken
+{
+public:
+    CancelToken();
+    ~CancelToken();
+    void cancel();
+    void reset();
+    bool isCancelled() const {return m_cancelled.load(std::memory_order_acquire);}
+    //Sleeps up to msecs, returns false if cancelled first
+    bool sleep(int msecs);
+    //Time since cancel() was called, -1 if it was not
+    qint64 msSinceCancel() const;
+    //Manual reset event set on cancel, for WaitForMultipleObjects (Windows only)
+    void *waitHandle() const {return m_event;}
+    enum {POLL_SLICE_MS = 5};   //longest wait between checks where there is no handle
+private:
+    std::atomic<bool> m_cancelled;
+    std::atomic<qint64> m_cancelTime;
+    QElapsedTimer m_clock;
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    void *m_event;
+    Q_DISABLE_COPY(CancelToken)
+};
+
+#endif // CANCELTOKEN_H
@@ -0,0 +1,126 @@
+#include "cansimulator.h"
+#include "canbootloader.h"
+#include "crc.h"
+
+CANSimulator::CANSimulator(QString interface, bool canFd, uint32_t baseId) :
+    QThread(), m_baseId(baseId), m_stop(false), m_unlocked(false), m_flashStart(0),
+    m_blockAddress(0), m_blockLength(0), m_blockFrames(0)
+{
+    m_socket.open(interface, canFd, QList<uint32_t>() << baseId << baseId + 1);
+}
+
+void CANSimulator::run()
+{
+    CanFrame frames[CANBootloader::WINDOW];
+    while (!m_stop) {
+        int count = m_socket.receive(frames, CANBootloader::WINDOW, 100);
+        if (count < 0) {
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (frames[i].id == m_baseId) {
+                command(frames[i]);
+            } else {
+                data(frames[i]);
+            }
+        }
+    }
+}
+
+static uint32_t readLE(const uint8_t *p, int len)
+{
+    uint32_t value = 0;
+    for (int i = len - 1; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+void CANSimulator::command(const CanFrame &frame)
+{
+    const uint8_t *p = frame.data;
+    switch (p[0]) {
+    case CANBootloader::BL_CMD_UNLOCK: {
+        uint32_t size = readLE(&p[5], 3);
+        if (frame.len < 8 || size == 0 || size > MAX_FLASH_SIZE) {
+            reply(CANBootloader::BL_RESP_ERROR);
+            return;
+        }
+        if (m_flashStart != readLE(&p[1], 4) || (uint32_t)m_flash.size() != size) {
+            m_flashStart = readLE(&p[1], 4);
+            m_flash.fill(0xff, size);
+        }
+        m_unlocked = true;
+        m_block.clear();
+        reply(CANBootloader::BL_RESP_OK);
+        return;
+    }
+    case CANBootloader::BL_CMD_DATA: {
+        uint32_t address = readLE(&p[1], 4);
+        uint32_t len = readLE(&p[5], 2);
+        if (!m_unlocked || frame.len < 7 || address < m_flashStart
+                || address - m_flashStart + len > (uint32_t)m_flash.size()) {
+            reply(CANBootloader::BL_RESP_ERROR);
+            return;
+        }
+        m_blockAddress = address;
+        m_blockLength = len;
+        m_block.clear();
+        m_blockFrames = 0;
+        return;
+    }
+    case CANBootloader::BL_CMD_VERIFY:
+        if (!m_unlocked || frame.len < 5) {
+            reply(CANBootloader::BL_RESP_ERROR);
+            return;
+        }
+        reply(CRC::crc32((const uint8_t *)m_flash.constData(), m_flash.size()) == readLE(&p[1], 4)
+              ? CANBootloader::BL_RESP_CRC_OK : CANBootloader::BL_RESP_CRC_FAIL);
+        return;
+    case CANBootloader::BL_CMD_RESET:
+        m_unlocked = false;
+        reply(CANBootloader::BL_RESP_OK);
+        return;
+    case CANBootloader::BL_CMD_READ_VERSION: {
+        uint8_t version[2] = {VERSION >> 8, VERSION & 0xff};
+        reply(CANBootloader::BL_RESP_OK, version, 2);
+        return;
+    }
+    default:
+        reply(CANBootloader::BL_RESP_ERROR);
+        return;
+    }
+}
+
+void CANSimulator::data(const CanFrame &frame)
+{
+    if (m_blockLength == 0 || frame.len < 2 || frame.data[0] != (uint8_t)m_blockFrames) {
+        //Out of sequence or no DATA command, drop the block
+        m_blockLength = 0;
+        reply(CANBootloader::BL_RESP_ERROR);
+        return;
+    }
+    //CAN-FD pads frames to the next valid length, only take what is left
+    int len = qMin((int)frame.len - 1, (int)(m_blockLength - m_block.size()));
+    m_block.append((const char *)&frame.data[1], len);
+    uint8_t seq = m_blockFrames++;
+    if ((uint32_t)m_block.size() == m_blockLength) {
+        memcpy(m_flash.data() + (m_blockAddress - m_flashStart), m_block.constData(), m_blockLength);
+        m_blockLength = 0;
+        reply(CANBootloader::BL_RESP_OK);
+    } else if (m_blockFrames % CANBootloader::ACK_INTERVAL == 0) {
+        reply(CANBootloader::BL_RESP_ACK, &seq, 1);
+    }
+}
+
+void CANSimulator::reply(uint8_t code, const uint8_t *args, int len)
+{
+    CanFrame frame;
+    frame.id = m_baseId + 2;
+    frame.len = len + 1;
+    frame.data[0] = code;
+    if (len > 0) {
+        memcpy(&frame.data[1], args, len);
+    }
+    m_socket.send(&frame, 1);
+}
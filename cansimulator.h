@@ -0,0 +1,37 @@
+#ifndef CANSIMULATOR_H
+#define CANSIMULATOR_H
+
+#include <QThread>
+#include <QByteArray>
+#include <atomic>
+#include "cansocket.h"
+
+//Simulated CAN bootloader node for testing CANBootloader on a vcan
+//interface.  Runs the node side of the protocol in canbootloader.h.
+class CANSimulator : public QThread
+{
+public:
+    CANSimulator(QString interface, bool canFd, uint32_t baseId);
+    bool isOpen() const {return m_socket.isOpen();}
+    QString errorString() const {return m_socket.errorString();}
+    void stop() {m_stop = true;}
+protected:
+    virtual void run() override;
+private:
+    enum {VERSION = 0x0301, MAX_FLASH_SIZE = 0x200000};
+    CanSocket m_socket;
+    uint32_t m_baseId;
+    std::atomic<bool> m_stop;
+    bool m_unlocked;
+    uint32_t m_flashStart;
+    QByteArray m_flash;
+    uint32_t m_blockAddress;
+    uint32_t m_blockLength;
+    QByteArray m_block;
+    int m_blockFrames;
+    void command(const CanFrame &frame);
+    void data(const CanFrame &frame);
+    void reply(uint8_t code, const uint8_t *args = nullptr, int len = 0);
+};
+
+#endif // CANSIMULATOR_H
@@ -0,0 +1,174 @@
+#include "cansocket.h"
+#include "canceltoken.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <QVector>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+CanSocket::CanSocket() : m_fd(-1), m_canFd(false)
+{
+
+}
+
+CanSocket::~CanSocket()
+{
+    close();
+}
+
+bool CanSocket::open(QString interface, bool canFd, const QList<uint32_t> &rxIds)
+{
+    close();
+    m_fd = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    if (m_fd < 0) {
+        m_error = QString("Unable to create CAN socket: %1").arg(strerror(errno));
+        return false;
+    }
+    m_canFd = canFd;
+    int enable = 1;
+    if (canFd && setsockopt(m_fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)) < 0) {
+        m_error = "Kernel does not support CAN-FD frames";
+        close();
+        return false;
+    }
+    QVector<struct can_filter> filters;
+    for (auto id : rxIds) {
+        filters.append({id, CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG});
+    }
+    setsockopt(m_fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters.constData(), filters.size() * sizeof(struct can_filter));
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface.toLocal8Bit().constData(), IFNAMSIZ - 1);
+    if (ioctl(m_fd, SIOCGIFINDEX, &ifr) < 0) {
+        m_error = QString("No CAN interface %1").arg(interface);
+        close();
+        return false;
+    }
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(m_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        m_error = QString("Unable to bind to %1: %2").arg(interface, strerror(errno));
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CanSocket::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+int CanSocket::dataLength(int len)
+{
+    //CAN-FD only has these lengths above 8, round up and pad
+    static const uint8_t fdLengths[] = {12, 16, 20, 24, 32, 48, 64};
+    if (len <= 8) {
+        return len;
+    }
+    for (auto i : fdLengths) {
+        if (len <= i) {
+            return i;
+        }
+    }
+    return 64;
+}
+
+bool CanSocket::send(const CanFrame *frames, int count)
+{
+    struct canfd_frame buffers[BATCH];
+    struct iovec iov[BATCH];
+    struct mmsghdr msgs[BATCH];
+    QElapsedTimer timer;
+    timer.start();
+    while (count > 0) {
+        int batch = qMin(count, (int)BATCH);
+        for (int i = 0; i < batch; ++i) {
+            int len = m_canFd ? dataLength(frames[i].len) : qMin((int)frames[i].len, 8);
+            memset(&buffers[i], 0, sizeof(buffers[i]));
+            buffers[i].can_id = frames[i].id & CAN_SFF_MASK;
+            buffers[i].len = len;
+            memcpy(buffers[i].data, frames[i].data, qMin((int)frames[i].len, len));
+            if (m_canFd) {
+                buffers[i].flags = CANFD_BRS;
+            }
+            iov[i].iov_base = &buffers[i];
+            iov[i].iov_len = m_canFd ? CANFD_MTU : CAN_MTU;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(m_fd, msgs, batch, 0);
+        if (sent < 0) {
+            //The interface queue is full, poll() does not report when it
+            //drains for raw CAN sockets, so back off briefly and retry
+            if ((errno == ENOBUFS || errno == EAGAIN || errno == EINTR) && timer.elapsed() < TX_TIMEOUT_MS) {
+                QThread::msleep(TX_RETRY_MS);
+                continue;
+            }
+            m_error = QString("CAN send failed: %1").arg(strerror(errno));
+            return false;
+        }
+        frames += sent;
+        count -= sent;
+    }
+    return true;
+}
+
+int CanSocket::receive(CanFrame *frames, int maxFrames, int wait_ms, CancelToken *cancel)
+{
+    struct canfd_frame buffers[BATCH];
+    struct iovec iov[BATCH];
+    struct mmsghdr msgs[BATCH];
+    QElapsedTimer timer;
+    timer.start();
+    struct pollfd fds = {m_fd, POLLIN, 0};
+    //Sliced so a cancel ends the wait within a few milliseconds
+    for (;;) {
+        if (cancel && cancel->isCancelled()) {
+            return 0;
+        }
+        int remaining = wait_ms - timer.elapsed();
+        if (remaining < 0) {
+            return 0;
+        }
+        int ret = poll(&fds, 1, cancel ? qMin(remaining, (int)CancelToken::POLL_SLICE_MS) : remaining);
+        if (ret > 0) {
+            break;
+        }
+        if (ret < 0 && errno != EINTR) {
+            m_error = QString("CAN receive failed: %1").arg(strerror(errno));
+            return -1;
+        }
+    }
+    int batch = qMin(maxFrames, (int)BATCH);
+    for (int i = 0; i < batch; ++i) {
+        iov[i].iov_base = &buffers[i];
+        iov[i].iov_len = sizeof(buffers[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received = recvmmsg(m_fd, msgs, batch, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    for (int i = 0; i < received; ++i) {
+        frames[i].id = buffers[i].can_id & CAN_SFF_MASK;
+        frames[i].len = buffers[i].len;
+        memcpy(frames[i].data, buffers[i].data, buffers[i].len);
+    }
+    return received;
+}
@@ -0,0 +1,41 @@
+#ifndef CANSOCKET_H
+#define CANSOCKET_H
+
+#include <QString>
+#include <QList>
+#include <stdint.h>
+
+class CancelToken;
+
+typedef struct {
+    uint32_t id;
+    uint8_t len;
+    uint8_t data[64];
+} CanFrame;
+
+//Raw SocketCAN socket, classic CAN or CAN-FD.  Frames go out and come in
+//in batches through sendmmsg/recvmmsg so a window of frames costs one
+//system call instead of one per frame.
+class CanSocket
+{
+public:
+    CanSocket();
+    ~CanSocket();
+    //Only frames with one of rxIds (11 bit) are received
+    bool open(QString interface, bool canFd, const QList<uint32_t> &rxIds);
+    void close();
+    bool isOpen() const {return m_fd >= 0;}
+    int maxPayload() const {return m_canFd ? 64 : 8;}
+    bool send(const CanFrame *frames, int count);
+    //Returns the number of frames received, 0 on timeout or cancel, -1 on error
+    int receive(CanFrame *frames, int maxFrames, int wait_ms, CancelToken *cancel = nullptr);
+    QString errorString() const {return m_error;}
+    static int dataLength(int len);
+private:
+    enum {BATCH = 32, TX_RETRY_MS = 1, TX_TIMEOUT_MS = 1000};
+    int m_fd;
+    bool m_canFd;
+    QString m_error;
+};
+
+#endif // CANSOCKET_H
@@ -0,0 +1,22 @@
+# Harmony bootloader engine as a shared library with a C API, for test
+# harnesses that flash many boards from one process.
+
+QT       += core serialport concurrent network
+QT       -= gui
+
+TEMPLATE = lib
+TARGET = harmonybootloader
+CONFIG += c++11 shared
+DEFINES += HB_BUILD_LIBRARY
+
+include(../engine.pri)
+
+SOURCES += \
+    harmonybootloader.cpp
+
+HEADERS += \
+    harmonybootloader.h
+
+qnx: target.path = /tmp/$${TARGET}/lib
+else: unix:!android: target.path = /opt/$${TARGET}/lib
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,250 @@
+#include "harmonybootloader.h"
+#include "hidbootloader.h"
+#include "uartbootloader.h"
+#include "imagecache.h"
+#ifdef Q_OS_LINUX
+#include "canbootloader.h"
+#endif
+#include <QCoreApplication>
+#include <memory>
+
+struct hb_session
+{
+    std::unique_ptr<Bootloader> bootloader;
+    QByteArray lastError;
+    QString lastMessage;
+    hb_progress_fn progress = nullptr;
+    hb_message_fn message = nullptr;
+    void *user = nullptr;
+};
+
+static hb_session *newSession(Bootloader *bootloader, int family)
+{
+    hb_session *session = new hb_session;
+    session->bootloader.reset(bootloader);
+    bootloader->setFamily(family);
+    //Direct connections, so these run on the thread making the call.  The
+    //engine only emits from that thread (HidBootloader::prepare() hands its
+    //errors back instead), and a queued connection would need an event loop
+    //the caller does not run.
+    QObject::connect(bootloader, &Bootloader::message, [session](QString m) {
+        session->lastMessage = m;
+        if (session->message) {
+            QByteArray utf8 = m.toUtf8();
+            session->message(utf8.constData(), session->user);
+        }
+    });
+    QObject::connect(bootloader, &Bootloader::progress, [session](int p) {
+        if (session->progress) {
+            session->progress(p, session->user);
+        }
+    });
+    return session;
+}
+
+static int fail(hb_session *session, int code, QString fallback)
+{
+    //The engine reports why through message(), use that when there is one
+    if (session->bootloader->isAborted()) {
+        code = HB_ERROR_CANCELLED;
+        session->lastError = "Cancelled";
+    } else {
+        session->lastError = (session->lastMessage.isEmpty() ? fallback : session->lastMessage).toUtf8();
+    }
+    return code;
+}
+
+static bool begin(hb_session *session)
+{
+    session->lastMessage.clear();
+    session->lastError.clear();
+    if (!session->bootloader->isConnected()) {
+        session->lastError = "Not connected";
+        return false;
+    }
+    return true;
+}
+
+static int end(hb_session *session, int result)
+{
+    //Cleared once a call is over, not when the next one starts, so an
+    //hb_cancel() made just before a call still cancels it
+    session->bootloader->cancelToken().reset();
+    return result;
+}
+
+int hb_api_version(void)
+{
+    return HB_API_VERSION;
+}
+
+void hb_init(void)
+{
+    if (QCoreApplication::instance()) {
+        return;
+    }
+    //Same names as the GUI so both share the on-disk image cache
+    static int argc = 1;
+    static char name[] = "harmonybootloader";
+    static char *argv[] = {name, nullptr};
+    QCoreApplication::setOrganizationName("QES");
+    QCoreApplication::setApplicationName("HarmonyBootloader");
+    new QCoreApplication(argc, argv);
+}
+
+hb_session *hb_open_hid(uint16_t vid, uint16_t pid, int family)
+{
+    return newSession(new HidBootloader(vid, pid), family);
+}
+
+hb_session *hb_open_uart(const char *port, int baud, uint32_t start_address,
+                         uint16_t erase_block_size, int family)
+{
+    if (!port || baud <= 0 || erase_block_size == 0) {
+        return nullptr;
+    }
+    return newSession(new UARTBootloader(QString::fromUtf8(port), baud, start_address, erase_block_size), family);
+}
+
+hb_session *hb_open_can(const char *interface, int can_fd, uint32_t start_address,
+                        uint16_t erase_block_size, int family)
+{
+#ifdef Q_OS_LINUX
+    if (!interface || erase_block_size == 0) {
+        return nullptr;
+    }
+    return newSession(new CANBootloader(QString::fromUtf8(interface), can_fd != 0,
+                                        start_address, erase_block_size), family);
+#else
+    (void) interface;
+    (void) can_fd;
+    (void) start_address;
+    (void) erase_block_size;
+    (void) family;
+    return nullptr;
+#endif
+}
+
+void hb_close(hb_session *session)
+{
+    delete session;
+}
+
+int hb_is_connected(hb_session *session)
+{
+    return session && session->bootloader->isConnected() ? 1 : 0;
+}
+
+int hb_boot_version(hb_session *session)
+{
+    if (!session || !session->bootloader->isConnected()) {
+        return 0;
+    }
+    return session->bootloader->readBootInfo();
+}
+
+int hb_load_image(hb_session *session, const char *files)
+{
+    if (!session || !files) {
+        return HB_ERROR_ARGUMENT;
+    }
+    session->lastMessage.clear();
+    if (!session->bootloader->setFile(QString::fromUtf8(files))) {
+        return end(session, fail(session, HB_ERROR_IMAGE, "Unable to load image"));
+    }
+    return end(session, HB_OK);
+}
+
+int hb_preload_image(const char *files, int family, uint32_t erase_block_size)
+{
+    if (!files) {
+        return HB_ERROR_ARGUMENT;
+    }
+    if (!ImageCache::instance().get(QString::fromUtf8(files), FamilyPolicy::forFamily(family).physicalAddresses,
+                                   erase_block_size)) {
+        return HB_ERROR_IMAGE;
+    }
+    return HB_OK;
+}
+
+void hb_set_blank_check(hb_session *session, uint32_t app_start, uint32_t length)
+{
+    if (session) {
+        session->bootloader->setBlankCheck(app_start, length);
+    }
+}
+
+int hb_flash(hb_session *session, hb_progress_fn progress, hb_message_fn message, void *user)
+{
+    if (!session) {
+        return HB_ERROR_ARGUMENT;
+    }
+    if (!begin(session)) {
+        return HB_ERROR_NOT_CONNECTED;
+    }
+    session->progress = progress;
+    session->message = message;
+    session->user = user;
+    int result = HB_OK;
+    if (!session->bootloader->eraseFlash() || session->bootloader->isAborted()) {
+        result = fail(session, HB_ERROR_ERASE, "Erase failed");
+    } else if (!session->bootloader->programFlash() || session->bootloader->isAborted()) {
+        result = fail(session, HB_ERROR_PROGRAM, "Programming failed");
+    }
+    session->progress = nullptr;
+    session->message = nullptr;
+    session->user = nullptr;
+    return end(session, result);
+}
+
+int hb_verify(hb_session *session)
+{
+    if (!session) {
+        return HB_ERROR_ARGUMENT;
+    }
+    if (!begin(session)) {
+        return HB_ERROR_NOT_CONNECTED;
+    }
+    if (!session->bootloader->verify()) {
+        return end(session, fail(session, HB_ERROR_VERIFY, "Verify failed"));
+    }
+    return end(session, HB_OK);
+}
+
+int hb_is_up_to_date(hb_session *session)
+{
+    if (!session) {
+        return HB_ERROR_ARGUMENT;
+    }
+    if (!begin(session)) {
+        return HB_ERROR_NOT_CONNECTED;
+    }
+    return end(session, session->bootloader->isUpToDate() ? 1 : 0);
+}
+
+int hb_jump_to_app(hb_session *session)
+{
+    if (!session) {
+        return HB_ERROR_ARGUMENT;
+    }
+    if (!begin(session)) {
+        return HB_ERROR_NOT_CONNECTED;
+    }
+    session->bootloader->jumpToApp();
+    return end(session, HB_OK);
+}
+
+void hb_cancel(hb_session *session)
+{
+    if (session) {
+        session->bootloader->abort();
+    }
+}
+
+const char *hb_last_error(hb_session *session)
+{
+    if (!session) {
+        return "No session";
+    }
+    return session->lastError.constData();
+}
@@ -0,0 +1,108 @@
+#ifndef HARMONYBOOTLOADER_H
+#define HARMONYBOOTLOADER_H
+
+/*
+ * C API for the Harmony bootloader engine.
+ *
+ * A session wraps one connection to one target.  Calls on a session block
+ * until they complete and must come from one thread at a time, except
+ * hb_cancel() which may be called from anywhere.  Parsed images are shared
+ * between sessions (and cached on disk across runs), so loading the same
+ * build for the next board costs a hash of the files rather than a parse.
+ *
+ * Functions returning int return HB_OK or a negative HB_ERROR_* code; the
+ * message for the last failure on a session is in hb_last_error().
+ */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(HB_BUILD_LIBRARY)
+#    define HB_API __declspec(dllexport)
+#  else
+#    define HB_API __declspec(dllimport)
+#  endif
+#else
+#  define HB_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HB_API_VERSION 1
+
+enum {
+    HB_OK = 0,
+    HB_ERROR_ARGUMENT = -1,
+    HB_ERROR_NOT_CONNECTED = -2,
+    HB_ERROR_IMAGE = -3,
+    HB_ERROR_ERASE = -4,
+    HB_ERROR_PROGRAM = -5,
+    HB_ERROR_VERIFY = -6,
+    HB_ERROR_CANCELLED = -7
+};
+
+enum {
+    HB_FAMILY_PIC32 = 0,
+    HB_FAMILY_ARM = 1,
+    HB_FAMILY_OTHER = 2
+};
+
+typedef struct hb_session hb_session;
+
+/* percent is 0..100 */
+typedef void (*hb_progress_fn)(int percent, void *user);
+/* message is UTF-8 and only valid for the duration of the call */
+typedef void (*hb_message_fn)(const char *message, void *user);
+
+/* Returns HB_API_VERSION of the library */
+HB_API int hb_api_version(void);
+
+/* Optional.  Creates a QCoreApplication if the host has none; call once
+ * from the thread that will outlive all sessions. */
+HB_API void hb_init(void);
+
+/* Sessions.  Return NULL only on bad arguments; check hb_is_connected() */
+HB_API hb_session *hb_open_hid(uint16_t vid, uint16_t pid, int family);
+/* port is a serial port name or tcp://host:port */
+HB_API hb_session *hb_open_uart(const char *port, int baud, uint32_t start_address,
+                                uint16_t erase_block_size, int family);
+/* Linux only, returns NULL elsewhere */
+HB_API hb_session *hb_open_can(const char *interface, int can_fd, uint32_t start_address,
+                               uint16_t erase_block_size, int family);
+HB_API void hb_close(hb_session *session);
+HB_API int hb_is_connected(hb_session *session);
+/* Bootloader version as major << 8 | minor, 0 if the target does not report one */
+HB_API int hb_boot_version(hb_session *session);
+
+/* Image to flash, several files separated by ';'.  Parsing is cached.
+   "-" or a named pipe streams Intel hex into a USB HID target as it
+   arrives, see imagestream.h */
+HB_API int hb_load_image(hb_session *session, const char *files);
+/* Parses into the shared cache ahead of any session */
+HB_API int hb_preload_image(const char *files, int family, uint32_t erase_block_size);
+
+/* Restricts HID erase to the application range when it is already blank.
+ * The range must lie within the flash of the exact part, a read past its
+ * end can fault the bootloader.  A length of 0 turns the check off. */
+HB_API void hb_set_blank_check(hb_session *session, uint32_t app_start, uint32_t length);
+
+/* Erase and program the loaded image.  Callbacks run on the calling thread
+ * and may be NULL. */
+HB_API int hb_flash(hb_session *session, hb_progress_fn progress, hb_message_fn message, void *user);
+HB_API int hb_verify(hb_session *session);
+/* 1 if the target already holds the loaded image, 0 if not */
+HB_API int hb_is_up_to_date(hb_session *session);
+HB_API int hb_jump_to_app(hb_session *session);
+
+/* Thread safe.  Ends the running call on this session with HB_ERROR_CANCELLED,
+ * or the next call if none is running */
+HB_API void hb_cancel(hb_session *session);
+HB_API const char *hb_last_error(hb_session *session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HARMONYBOOTLOADER_H */
@@ -0,0 +1,51 @@
+#include "crc.h"
+
+uint16_t CRC::crc16(const uint8_t *data, uint32_t len, uint16_t crc)
+{
+    static const uint16_t crc_table[16] =
+    {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+    };
+    uint32_t i;
+
+    while(len--)
+    {
+        i = (crc >> 12) ^ (*data >> 4);
+        crc = crc_table[i & 0x0F] ^ (crc << 4);
+        i = (crc >> 12) ^ (*data >> 0);
+        crc = crc_table[i & 0x0F] ^ (crc << 4);
+        data++;
+    }
+
+    return (crc & 0xFFFF);
+}
+
+uint32_t CRC::crc32(const uint8_t *data, uint32_t len, uint32_t crc)
+{
+    static const struct CRCTable {
+        uint32_t crc_tab[256];
+        CRCTable() {
+            for (int i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int j = 0; j < 8; j++)
+                {
+                    if (value & 1)
+                    {
+                        value = (value >> 1) ^ 0xEDB88320;
+                    }
+                    else
+                    {
+                        value >>= 1;
+                    }
+                }
+                crc_tab[i] = value;
+            }
+        }
+    } table;
+    while (len--) {
+        crc = table.crc_tab[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
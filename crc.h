@@ -0,0 +1,15 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+class CRC
+{
+public:
+    //CRC-16/XMODEM used by the HID bootloader frames and READ_CRC
+    static uint16_t crc16(const uint8_t *data, uint32_t len, uint16_t crc = 0);
+    //CRC-32 without final xor as used by the UART bootloader VERIFY command
+    static uint32_t crc32(const uint8_t *data, uint32_t len, uint32_t crc = 0xffffffff);
+};
+
+#endif // CRC_H
@@ -0,0 +1,26 @@
+# Resident flashing service.  Keeps images, links and per-port job queues in
+# memory and takes jobs over a local socket, see flashdaemon.h.
+
+QT       += core serialport concurrent network
+QT       -= gui
+
+TARGET = harmonybootloaderd
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../engine.pri)
+
+SOURCES += \
+    ../workerthread.cpp \
+    flashdaemon.cpp \
+    main.cpp \
+    portqueue.cpp
+
+HEADERS += \
+    ../workerthread.h \
+    flashdaemon.h \
+    portqueue.h
+
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
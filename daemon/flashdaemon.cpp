@@ -0,0 +1,157 @@
+#include "flashdaemon.h"
+#include "imagecache.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSerialPortInfo>
+
+FlashDaemon::FlashDaemon() : QLocalServer(), m_nextJobId(1)
+{
+    connect(this, &QLocalServer::newConnection, this, &FlashDaemon::onNewConnection);
+}
+
+FlashDaemon::~FlashDaemon()
+{
+    //Queues wait for their running job
+    qDeleteAll(m_queues);
+}
+
+void FlashDaemon::onNewConnection()
+{
+    while (QLocalSocket *client = nextPendingConnection()) {
+        connect(client, &QLocalSocket::readyRead, this, [this, client]() {onReadyRead(client);});
+        connect(client, &QLocalSocket::disconnected, client, &QObject::deleteLater);
+    }
+}
+
+void FlashDaemon::onReadyRead(QLocalSocket *client)
+{
+    while (client->canReadLine()) {
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(client->readLine(), &parseError);
+        if (!doc.isObject()) {
+            send(client, QJsonObject{{"event", "error"}, {"message", parseError.errorString()}});
+            continue;
+        }
+        handleRequest(client, doc.object());
+    }
+}
+
+void FlashDaemon::handleRequest(QLocalSocket *client, const QJsonObject &request)
+{
+    QString cmd = request["cmd"].toString();
+    if (cmd == "flash") {
+        flash(client, request);
+    } else if (cmd == "cancel") {
+        int job = request["job"].toInt();
+        PortQueue *queue = m_queues.value(m_jobPorts.value(job));
+        if (!queue || !queue->cancel(job)) {
+            send(client, QJsonObject{{"event", "error"}, {"job", job}, {"message", "No such job"}});
+        }
+    } else if (cmd == "preload") {
+        //Parsed into the shared cache, the job that uses it only hashes the files
+        ImageCache::instance().preload(request["file"].toString(),
+                                       FamilyPolicy::forFamily(request["family"].toInt()).physicalAddresses,
+                                       request["erase block size"].toInt());
+    } else if (cmd == "status") {
+        send(client, status());
+    } else if (cmd == "watch") {
+        if (!m_watchers.contains(client)) {
+            m_watchers.append(client);
+        }
+        send(client, status());
+    } else {
+        send(client, QJsonObject{{"event", "error"}, {"message", "Unknown command " + cmd}});
+    }
+}
+
+void FlashDaemon::flash(QLocalSocket *client, const QJsonObject &request)
+{
+    QString port = PortQueue::portKey(request);
+    if (port.isEmpty() || request["file"].toString().isEmpty()) {
+        send(client, QJsonObject{{"event", "error"}, {"tag", request["tag"]},
+                                 {"message", "flash needs a port and a file"}});
+        return;
+    }
+    //Only the settings that open the link, so jobs differing in file or
+    //priority keep the bootloader open
+    QJsonObject link;
+    for (QString key : QStringList{"connection", "port", "vid", "pid", "baud", "start address",
+                                   "erase block size", "native serial", "compression", "can fd"}) {
+        if (request.contains(key)) {
+            link[key] = request[key];
+        }
+    }
+    FlashJob job = {m_nextJobId++, request["priority"].toInt(0), link, request["file"].toString(),
+                    request["family"].toInt(Bootloader::OTHER), request["verify first"].toBool(false),
+                    request["realtime"].toBool(false), request["realtime core"].toInt(-1)};
+    m_jobClients.insert(job.id, client);
+    m_jobPorts.insert(job.id, port);
+    if (request.contains("tag")) {
+        m_jobTags.insert(job.id, request["tag"]);
+    }
+    PortQueue *queue = m_queues.value(port);
+    if (!queue) {
+        queue = new PortQueue(port);
+        connect(queue, &PortQueue::jobEvent, this, &FlashDaemon::onJobEvent);
+        m_queues.insert(port, queue);
+    }
+    int position = queue->enqueue(job);
+    QJsonObject queued{{"event", "queued"}, {"job", job.id}, {"port", port},
+                       {"position", position}, {"tag", request["tag"]}};
+    send(client, queued);
+    notifyWatchers(queued, client);
+}
+
+void FlashDaemon::onJobEvent(int job, QJsonObject event)
+{
+    event["job"] = job;
+    event["port"] = m_jobPorts.value(job);
+    if (m_jobTags.contains(job)) {
+        event["tag"] = m_jobTags[job];
+    }
+    QPointer<QLocalSocket> client = m_jobClients.value(job);
+    if (client) {
+        send(client, event);
+    }
+    notifyWatchers(event, client);
+    if (event["event"].toString() == "finished") {
+        m_jobClients.remove(job);
+        m_jobPorts.remove(job);
+        m_jobTags.remove(job);
+    }
+}
+
+void FlashDaemon::notifyWatchers(const QJsonObject &event, QLocalSocket *sentTo)
+{
+    //Serialised once for all of them, dashboards watch every progress event
+    QByteArray line;
+    for (int i = m_watchers.size() - 1; i >= 0; --i) {
+        QLocalSocket *watcher = m_watchers[i];
+        if (!watcher) {
+            m_watchers.removeAt(i);
+        } else if (watcher != sentTo) {
+            if (line.isEmpty()) {
+                line = QJsonDocument(event).toJson(QJsonDocument::Compact) + '\n';
+            }
+            watcher->write(line);
+        }
+    }
+}
+
+QJsonObject FlashDaemon::status() const
+{
+    QJsonArray queues;
+    for (auto queue : m_queues) {
+        queues.append(queue->status());
+    }
+    QJsonArray serialPorts;
+    for (auto &info : QSerialPortInfo::availablePorts()) {
+        serialPorts.append(info.portName());
+    }
+    return QJsonObject{{"event", "status"}, {"queues", queues}, {"serial ports", serialPorts}};
+}
+
+void FlashDaemon::send(QLocalSocket *client, const QJsonObject &event)
+{
+    client->write(QJsonDocument(event).toJson(QJsonDocument::Compact) + '\n');
+}
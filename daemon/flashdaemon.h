@@ -0,0 +1,52 @@
+#ifndef FLASHDAEMON_H
+#define FLASHDAEMON_H
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QHash>
+#include <QMap>
+#include <QList>
+#include "portqueue.h"
+
+//Takes flash jobs over a local socket and runs them on per-port queues.
+//The protocol is one JSON object per line in each direction.
+//
+//Requests ("cmd"):
+//  flash    link settings ("connection" USB/UART/CAN, "port" or "vid"/"pid",
+//           "baud", "start address", "erase block size", ...), "file",
+//           "family", optional "priority", "verify first", "realtime",
+//           "realtime core" and "tag" (echoed back)
+//  cancel   "job"
+//  preload  "file", "family", "erase block size"
+//  status
+//  watch    receive the events of every job from now on, not just own ones
+//
+//Events ("event"), all carrying "job" and "port" once a job is assigned:
+//  queued (with "position"), started ("bytes" of image data), progress
+//  ("phase" and "percent" within it, 0 as each phase starts), message
+//  ("text"), finished ("success" and per-phase times in ms), error, status
+class FlashDaemon : public QLocalServer
+{
+    Q_OBJECT
+public:
+    FlashDaemon();
+    ~FlashDaemon();
+private:
+    int m_nextJobId;
+    QMap<QString, PortQueue *> m_queues;
+    QHash<int, QPointer<QLocalSocket>> m_jobClients;
+    QHash<int, QString> m_jobPorts;
+    QHash<int, QJsonValue> m_jobTags;
+    QList<QPointer<QLocalSocket>> m_watchers;
+    void onNewConnection();
+    void onReadyRead(QLocalSocket *client);
+    void handleRequest(QLocalSocket *client, const QJsonObject &request);
+    void flash(QLocalSocket *client, const QJsonObject &request);
+    void onJobEvent(int job, QJsonObject event);
+    void notifyWatchers(const QJsonObject &event, QLocalSocket *sentTo);
+    QJsonObject status() const;
+    static void send(QLocalSocket *client, const QJsonObject &event);
+};
+
+#endif // FLASHDAEMON_H
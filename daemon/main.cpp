@@ -0,0 +1,37 @@
+#include "flashdaemon.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLocalSocket>
+
+static const int PROBE_TIMEOUT_MS = 500;
+
+int main(int argc, char *argv[])
+{
+    //Same names as the GUI so the on-disk image cache and settings are shared
+    QCoreApplication::setOrganizationName("QES");
+    QCoreApplication::setApplicationName("HarmonyBootloader");
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption socketOption("socket", "Local socket name or path to listen on.",
+                                    "name", "harmonybootloader");
+    parser.addOption(socketOption);
+    parser.process(a);
+    QString name = parser.value(socketOption);
+    //Only a socket left behind by a daemon that did not shut down cleanly is
+    //removed, one that still answers belongs to a running daemon
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(PROBE_TIMEOUT_MS)) {
+        qCritical("Another daemon is already listening on %s", qPrintable(name));
+        return 1;
+    }
+    QLocalServer::removeServer(name);
+    FlashDaemon daemon;
+    if (!daemon.listen(name)) {
+        qCritical("Unable to listen: %s", qPrintable(daemon.errorString()));
+        return 1;
+    }
+    return a.exec();
+}
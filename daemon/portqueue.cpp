@@ -0,0 +1,245 @@
+#include "portqueue.h"
+#include <QJsonArray>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrent>
+#include "hidbootloader.h"
+#include "uartbootloader.h"
+#ifdef Q_OS_LINUX
+#include "canbootloader.h"
+#endif
+
+PortQueue::PortQueue(QString name, QObject *parent) : QObject(parent),
+    m_name(name), m_current{0, 0, QJsonObject(), QString(), Bootloader::OTHER, false, false, -1},
+    m_reopen(false), m_bootVersion(0), m_opening(false), m_openCancelled(false)
+{
+    connect(&m_openWatcher, &QFutureWatcher<OpenResult>::finished, this, &PortQueue::onLinkOpened);
+}
+
+PortQueue::~PortQueue()
+{
+    if (m_opening) {
+        //Never handed over
+        m_openWatcher.waitForFinished();
+        delete m_openWatcher.result().opened;
+    }
+    if (m_worker) {
+        m_bootloader->abort();
+        m_worker->wait();
+    }
+}
+
+QString PortQueue::portKey(const QJsonObject &link)
+{
+    //One HID device per vid:pid can be told apart, so that is the port
+    if (link["connection"].toString() == "USB") {
+        return QString("usb:%1:%2").arg(link["vid"].toString().toLower(), link["pid"].toString().toLower());
+    }
+    return link["port"].toString();
+}
+
+int PortQueue::enqueue(const FlashJob &job)
+{
+    int position = 0;
+    while (position < m_pending.size() && m_pending[position].priority >= job.priority) {
+        ++position;
+    }
+    m_pending.insert(position, job);
+    if (!isBusy()) {
+        //From the event loop, so the caller reports the job as queued first
+        QTimer::singleShot(0, this, &PortQueue::startNext);
+        return position;
+    }
+    return position + 1;
+}
+
+bool PortQueue::cancel(int id)
+{
+    if (m_worker && m_current.id == id) {
+        //Finishes through onWorkerFinished like any other job
+        m_bootloader->abort();
+        return true;
+    }
+    if (m_opening && m_current.id == id) {
+        //Finishes in onLinkOpened, the link is kept for the next job
+        m_openCancelled = true;
+        return true;
+    }
+    for (int i = 0; i < m_pending.size(); ++i) {
+        if (m_pending[i].id == id) {
+            m_pending.removeAt(i);
+            emit jobEvent(id, QJsonObject{{"event", "finished"}, {"success", false}, {"cancelled", true}});
+            return true;
+        }
+    }
+    return false;
+}
+
+QJsonObject PortQueue::status() const
+{
+    QJsonArray pending;
+    for (auto &i : m_pending) {
+        pending.append(i.id);
+    }
+    QJsonObject status{{"port", m_name}, {"pending", pending},
+                       {"open", m_bootloader != nullptr}};
+    if (isBusy()) {
+        status["running"] = m_current.id;
+    }
+    return status;
+}
+
+void PortQueue::startNext()
+{
+    if (!isBusy() && !m_pending.isEmpty()) {
+        startJob(m_pending.takeFirst());
+    }
+}
+
+void PortQueue::startJob(const FlashJob &job)
+{
+    m_current = job;
+    m_opening = true;
+    m_openCancelled = false;
+    if (!m_bootloader || m_reopen || job.link != m_link || !m_bootloader->isConnected()) {
+        m_bootloader = nullptr;
+        m_link = job.link;
+        m_reopen = false;
+    }
+    //The HID device scan, boot info read and image parse can all take a
+    //while, none of it may hold up the event loop the other ports share
+    Bootloader *reused = m_bootloader.get();
+    QThread *home = thread();
+    QString name = m_name;
+    m_openWatcher.setFuture(QtConcurrent::run([job, reused, home, name]() {
+        OpenResult result = {nullptr, 0, QString()};
+        Bootloader *bootloader = reused;
+        if (!bootloader) {
+            bootloader = openLink(job.link, name, result.error);
+            if (!bootloader) {
+                return result;
+            }
+            result.version = bootloader->readBootInfo();
+            result.opened = bootloader;
+        }
+        bootloader->setFamily(job.family);
+        bootloader->setBlankCheck(0, 0);
+        if (!bootloader->setFile(job.fileNames)) {
+            result.error = "Unable to open firmware file " + job.fileNames;
+        }
+        if (result.opened) {
+            result.opened->moveToThread(home);
+        }
+        return result;
+    }));
+}
+
+void PortQueue::onLinkOpened()
+{
+    OpenResult result = m_openWatcher.result();
+    m_opening = false;
+    if (result.opened) {
+        m_bootloader.reset(result.opened);
+        m_bootVersion = result.version;
+        //Emitted on the worker thread, queued here in order.  Progress is
+        //per phase, so every event names the phase it belongs to.
+        m_phase.clear();
+        connect(m_bootloader.get(), &Bootloader::phaseStarted, this, [this](QString name) {
+            m_phase = name;
+            emit jobEvent(m_current.id, QJsonObject{{"event", "progress"}, {"phase", name}, {"percent", 0}});
+        });
+        connect(m_bootloader.get(), &Bootloader::progress, this, [this](int p) {
+            emit jobEvent(m_current.id, QJsonObject{{"event", "progress"}, {"phase", m_phase}, {"percent", p}});
+        });
+        connect(m_bootloader.get(), &Bootloader::message, this, [this](QString m) {
+            emit jobEvent(m_current.id, QJsonObject{{"event", "message"}, {"text", m}});
+        });
+    }
+    if (result.error.isEmpty() && m_openCancelled) {
+        emit jobEvent(m_current.id, QJsonObject{{"event", "finished"}, {"success", false}, {"cancelled", true}});
+        startNext();
+        return;
+    }
+    if (!result.error.isEmpty()) {
+        emit jobEvent(m_current.id, QJsonObject{{"event", "finished"}, {"success", false}, {"error", result.error}});
+        startNext();
+        return;
+    }
+    m_bootloader->cancelToken().reset();
+    emit jobEvent(m_current.id, QJsonObject{{"event", "started"}, {"port", m_name},
+                                            {"boot version", QString("%1.%2").arg(m_bootVersion >> 8).arg(m_bootVersion & 0xff)},
+                                            {"bytes", (qint64)m_bootloader->imageSize()}});
+    m_worker.reset(new WorkerThread(m_bootloader.get()));
+    m_worker->setVerifyFirst(m_current.verifyFirst);
+    m_worker->setRealtime(m_current.realtime, m_current.realtimeCore);
+    connect(m_worker.get(), &QThread::finished, this, &PortQueue::onWorkerFinished);
+    m_worker->start();
+}
+
+void PortQueue::onWorkerFinished()
+{
+    //Queued behind the job's own progress and message events
+    m_worker->wait();
+    const JobStats &stats = m_worker->stats();
+    QJsonObject event{{"event", "finished"}, {"success", stats.success},
+                      {"cancelled", stats.cancelMs >= 0}, {"up to date", stats.upToDate},
+                      {"check ms", stats.checkMs}, {"erase ms", stats.eraseMs},
+                      {"program ms", stats.programMs}, {"verify ms", stats.verifyMs},
+                      {"total ms", stats.totalMs}, {"summary", m_worker->statsSummary()}};
+    //A HID target that jumped to its application is gone, the next board
+    //enumerates as a new device.  After a failure the link may be what is
+    //wrong, so it is opened again too.
+    m_reopen = !stats.success || m_link["connection"].toString() == "USB";
+    m_worker = nullptr;
+    emit jobEvent(m_current.id, event);
+    startNext();
+}
+
+Bootloader *PortQueue::openLink(const QJsonObject &link, QString name, QString &error)
+{
+    //Runs on a pool thread, the bootloader is handed back by onLinkOpened
+    QString connection = link["connection"].toString();
+    bool ok;
+    uint32_t startAddress = link["start address"].toString().toUInt(&ok, 16);
+    uint32_t eraseBlockSize = link["erase block size"].toInt();
+    std::unique_ptr<Bootloader> bootloader;
+    if (connection == "USB") {
+        uint16_t vid = link["vid"].toString().toUShort(&ok, 16);
+        uint16_t pid = ok ? link["pid"].toString().toUShort(&ok, 16) : 0;
+        if (!ok) {
+            error = "Invalid vid/pid";
+            return nullptr;
+        }
+        bootloader.reset(new HidBootloader(vid, pid));
+    } else if (connection == "UART") {
+        if (eraseBlockSize == 0 || eraseBlockSize > 0xffff) {
+            error = "Invalid erase block size";
+            return nullptr;
+        }
+        UARTBootloader *uart = new UARTBootloader(link["port"].toString(), link["baud"].toInt(115200),
+                                                  startAddress, eraseBlockSize);
+        uart->setNativeSerial(link["native serial"].toBool(true));
+        uart->setCompression(link["compression"].toBool(false));
+        //The port stays open from one board to the next
+        uart->setKeepOpen(true);
+        bootloader.reset(uart);
+    }
+#ifdef Q_OS_LINUX
+    else if (connection == "CAN") {
+        if (eraseBlockSize == 0 || eraseBlockSize > 0xffff) {
+            error = "Invalid erase block size";
+            return nullptr;
+        }
+        bootloader.reset(new CANBootloader(link["port"].toString(), link["can fd"].toBool(false),
+                                           startAddress, eraseBlockSize));
+    }
+#endif
+    else {
+        error = "Unknown connection type " + connection;
+        return nullptr;
+    }
+    if (!bootloader->isConnected()) {
+        error = "Unable to connect to " + name;
+        return nullptr;
+    }
+    return bootloader.release();
+}
@@ -0,0 +1,68 @@
+#ifndef PORTQUEUE_H
+#define PORTQUEUE_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QList>
+#include <QFutureWatcher>
+#include <memory>
+#include "bootloader.h"
+#include "workerthread.h"
+
+typedef struct {
+    int id;
+    int priority;           //higher runs first, equal priorities in arrival order
+    QJsonObject link;       //connection settings, see PortQueue::openLink
+    QString fileNames;
+    int family;
+    bool verifyFirst;
+    bool realtime;
+    int realtimeCore;
+} FlashJob;
+
+typedef struct {
+    Bootloader *opened;     //new link handed over to the queue, null if reused or failed
+    int version;
+    QString error;
+} OpenResult;
+
+//Jobs for one port (or one USB vid:pid), run one at a time on a WorkerThread.
+//The bootloader stays open between jobs while the link settings are the same
+//and the last job succeeded, so the next board starts with the port open.
+//Opening the link and loading the image run on a pool thread, a slow or
+//missing device holds up its own queue and nothing else.
+class PortQueue : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PortQueue(QString name, QObject *parent = nullptr);
+    ~PortQueue();
+    static QString portKey(const QJsonObject &link);
+    //Returns the number of jobs ahead, including the running one
+    int enqueue(const FlashJob &job);
+    bool cancel(int id);
+    QJsonObject status() const;
+signals:
+    void jobEvent(int job, QJsonObject event);
+private:
+    QString m_name;
+    QList<FlashJob> m_pending;
+    FlashJob m_current;
+    std::unique_ptr<Bootloader> m_bootloader;
+    QJsonObject m_link;
+    bool m_reopen;
+    int m_bootVersion;
+    QString m_phase;        //phase of the running job, see Bootloader::phaseStarted
+    std::unique_ptr<WorkerThread> m_worker;
+    QFutureWatcher<OpenResult> m_openWatcher;
+    bool m_opening;
+    bool m_openCancelled;
+    bool isBusy() const {return m_worker || m_opening;}
+    void startNext();
+    void startJob(const FlashJob &job);
+    void onLinkOpened();
+    void onWorkerFinished();
+    static Bootloader *openLink(const QJsonObject &link, QString name, QString &error);
+};
+
+#endif // PORTQUEUE_H
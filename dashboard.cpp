@@ -0,0 +1,94 @@
+#include "dashboard.h"
+#include <QApplication>
+#include <QHeaderView>
+#include <QJsonDocument>
+#include <QStyleOption>
+#include <QStyledItemDelegate>
+#include <QVBoxLayout>
+
+//Draws the progress column as a bar
+class ProgressDelegate : public QStyledItemDelegate
+{
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+    virtual void paint(QPainter *painter, const QStyleOptionViewItem &option,
+                       const QModelIndex &index) const override
+    {
+        QStyleOptionProgressBar bar;
+        bar.rect = option.rect.adjusted(2, 2, -2, -2);
+        bar.state = option.state | QStyle::State_Horizontal;
+        bar.minimum = 0;
+        bar.maximum = 100;
+        bar.progress = index.data().toInt();
+        bar.text = QString("%1 %").arg(bar.progress);
+        bar.textVisible = true;
+        QApplication::style()->drawControl(QStyle::CE_ProgressBar, &bar, painter);
+    }
+};
+
+Dashboard::Dashboard(QString serverName, QWidget *parent) : QWidget(parent, Qt::Window),
+    m_serverName(serverName)
+{
+    setWindowTitle(QApplication::applicationName() + " dashboard");
+    m_view = new QTableView(this);
+    m_view->setModel(&m_model);
+    m_view->setItemDelegateForColumn(SessionModel::PROGRESS, new ProgressDelegate(m_view));
+    m_view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_view->setWordWrap(false);
+    //Fixed row heights, nothing is measured again as rows update
+    m_view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    m_view->verticalHeader()->hide();
+    m_view->horizontalHeader()->setStretchLastSection(true);
+    m_view->setColumnWidth(SessionModel::STATION, 160);
+    m_view->setColumnWidth(SessionModel::PHASE, 180);
+    m_view->setColumnWidth(SessionModel::PROGRESS, 140);
+    m_statusLabel = new QLabel(this);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_view);
+    layout->addWidget(m_statusLabel);
+    resize(1000, 480);
+
+    connect(&m_socket, &QLocalSocket::connected, this, &Dashboard::onConnected);
+    connect(&m_socket, &QLocalSocket::readyRead, this, &Dashboard::onReadyRead);
+    //Failed connects never report disconnected, the state covers both
+    connect(&m_socket, &QLocalSocket::stateChanged, this, [this](QLocalSocket::LocalSocketState state) {
+        if (state == QLocalSocket::UnconnectedState) {
+            onDisconnected();
+        }
+    });
+    m_reconnectTimer.setSingleShot(true);
+    m_reconnectTimer.setInterval(RECONNECT_MS);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &Dashboard::connectToDaemon);
+    connectToDaemon();
+}
+
+void Dashboard::connectToDaemon()
+{
+    m_statusLabel->setText("Connecting to " + m_serverName);
+    m_socket.connectToServer(m_serverName);
+}
+
+void Dashboard::onConnected()
+{
+    //Jobs from before this are only seen from their next event on
+    m_model.clear();
+    m_socket.write("{\"cmd\":\"watch\"}\n");
+    m_statusLabel->setText("Watching " + m_serverName);
+}
+
+void Dashboard::onDisconnected()
+{
+    m_statusLabel->setText(QString("No flashing daemon on %1, retrying").arg(m_serverName));
+    m_reconnectTimer.start();
+}
+
+void Dashboard::onReadyRead()
+{
+    //Only stored here, the model announces the changes once per frame
+    while (m_socket.canReadLine()) {
+        QJsonDocument doc = QJsonDocument::fromJson(m_socket.readLine());
+        if (doc.isObject()) {
+            m_model.applyEvent(doc.object());
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <QWidget>
+#include <QLocalSocket>
+#include <QLabel>
+#include <QTableView>
+#include <QTimer>
+#include "sessionmodel.h"
+
+//Every station of a flashing daemon on this host at a glance.  Watches the
+//daemon's socket for the events of all jobs, whoever submitted them, and
+//reconnects when the daemon is restarted.
+class Dashboard : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit Dashboard(QString serverName, QWidget *parent = nullptr);
+private:
+    enum {RECONNECT_MS = 2000};
+    QString m_serverName;
+    QLocalSocket m_socket;
+    SessionModel m_model;
+    QTableView *m_view;
+    QLabel *m_statusLabel;
+    QTimer m_reconnectTimer;
+    void connectToDaemon();
+    void onConnected();
+    void onDisconnected();
+    void onReadyRead();
+};
+
+#endif // DASHBOARD_H
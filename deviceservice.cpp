@@ -0,0 +1,186 @@
+#include "deviceservice.h"
+#include "hidbootloader.h"
+#ifdef Q_OS_LINUX
+#include "canbootloader.h"
+#endif
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent/QtConcurrent>
+#include <QtSerialPort/QSerialPortInfo>
+#include <QNetworkInterface>
+
+DeviceService::DeviceService(QObject *parent) : QObject(parent),
+    m_scanning(false), m_connecting(false), m_connectingCan(false), m_triggering(false), m_portKind(SERIAL_PORTS), m_scanKind(SERIAL_PORTS)
+{
+    //One thread keeps scans and connects from overlapping on the same device
+    m_pool.setMaxThreadCount(1);
+    m_portTimer.setInterval(PORT_SCAN_INTERVAL_MS);
+    connect(&m_portTimer, &QTimer::timeout, this, &DeviceService::scanPorts);
+    connect(&m_familiesWatcher, &QFutureWatcher<QJsonObject>::finished, this, [this]() {
+        m_families = m_familiesWatcher.result()["families"].toArray();
+        m_triggers = m_familiesWatcher.result()["triggers"].toArray();
+        emit familiesLoaded();
+    });
+    connect(&m_portsWatcher, &QFutureWatcher<QStringList>::finished, this, [this]() {
+        m_scanning = false;
+        if (m_scanKind != m_portKind) {
+            //Switched between serial and CAN while scanning
+            scanPorts();
+            return;
+        }
+        QStringList ports = m_portsWatcher.result();
+        if (ports != m_ports) {
+            m_ports = ports;
+            emit portsChanged();
+        }
+    });
+    connect(&m_connectWatcher, &QFutureWatcher<ConnectResult>::finished, this, [this]() {
+        m_connecting = false;
+        ConnectResult result = m_connectWatcher.result();
+        if (m_connectingCan) {
+            emit canConnected(result.bootloader, result.version);
+        } else {
+            emit hidConnected(result.bootloader, result.version);
+        }
+    });
+    connect(&m_triggerWatcher, &QFutureWatcher<TriggerResult>::finished, this, [this]() {
+        m_triggering = false;
+        TriggerResult result = m_triggerWatcher.result();
+        emit bootloaderTriggered(result.success, result.report);
+    });
+}
+
+DeviceService::~DeviceService()
+{
+    m_portTimer.stop();
+    m_pool.waitForDone();
+    //A connect that finished after the window went away was never handed over
+    if (m_connecting) {
+        delete m_connectWatcher.result().bootloader;
+    }
+}
+
+void DeviceService::loadFamilies()
+{
+    m_familiesWatcher.setFuture(QtConcurrent::run(&m_pool, &DeviceService::readDevices));
+}
+
+QJsonObject DeviceService::readDevices()
+{
+    //Next to the executable first, then the working directory as before
+    QFile file(QCoreApplication::applicationDirPath() + "/devices.json");
+    if (!file.exists()) {
+        file.setFileName("devices.json");
+    }
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QJsonObject();
+    }
+    QJsonDocument d = QJsonDocument::fromJson(file.readAll());
+    return d.object();
+}
+
+void DeviceService::scanPorts()
+{
+    if (m_scanning) {
+        return;
+    }
+    m_scanning = true;
+    m_scanKind = m_portKind;
+    PortKind kind = m_portKind;
+    m_portsWatcher.setFuture(QtConcurrent::run(&m_pool, [kind]() {
+        QStringList ports;
+        if (kind == CAN_INTERFACES) {
+            for (auto &&i : QNetworkInterface::allInterfaces()) {
+                if (i.type() == QNetworkInterface::CanBus) {
+                    ports.append(i.name());
+                }
+            }
+            return ports;
+        }
+        for (auto &&i : QSerialPortInfo::availablePorts()) {
+            ports.append(i.portName());
+        }
+        return ports;
+    }));
+}
+
+void DeviceService::setPortKind(PortKind kind)
+{
+    if (kind != m_portKind) {
+        m_portKind = kind;
+        m_ports.clear();
+        emit portsChanged();
+    }
+}
+
+void DeviceService::watchPorts(bool enable)
+{
+    if (enable) {
+        scanPorts();
+        m_portTimer.start();
+    } else {
+        m_portTimer.stop();
+    }
+}
+
+void DeviceService::connectHid(uint16_t vid, uint16_t pid)
+{
+    if (m_connecting) {
+        return;
+    }
+    m_connecting = true;
+    m_connectingCan = false;
+    QThread *guiThread = thread();
+    m_connectWatcher.setFuture(QtConcurrent::run(&m_pool, [vid, pid, guiThread]() {
+        ConnectResult result = {nullptr, 0};
+        HidBootloader *hid = new HidBootloader(vid, pid);
+        if (!hid->isConnected()) {
+            delete hid;
+            return result;
+        }
+        result.version = hid->readBootInfo();
+        hid->moveToThread(guiThread);
+        result.bootloader = hid;
+        return result;
+    }));
+}
+
+#ifdef Q_OS_LINUX
+void DeviceService::connectCan(QString interface, bool canFd, uint32_t startAddress, uint16_t eraseBlockSize)
+{
+    if (m_connecting) {
+        return;
+    }
+    m_connecting = true;
+    m_connectingCan = true;
+    QThread *guiThread = thread();
+    m_connectWatcher.setFuture(QtConcurrent::run(&m_pool, [interface, canFd, startAddress, eraseBlockSize, guiThread]() {
+        ConnectResult result = {nullptr, 0};
+        CANBootloader *can = new CANBootloader(interface, canFd, startAddress, eraseBlockSize);
+        if (!can->isConnected()) {
+            delete can;
+            return result;
+        }
+        result.version = can->readBootInfo();
+        can->moveToThread(guiThread);
+        result.bootloader = can;
+        return result;
+    }));
+}
+#endif
+
+void DeviceService::triggerBootloader(const QJsonObject &profile, const QJsonObject &target)
+{
+    //Same thread as the scans and connects, a port scan never sees the
+    //device half way through restarting
+    if (m_connecting || m_triggering) {
+        return;
+    }
+    m_triggering = true;
+    m_triggerWatcher.setFuture(QtConcurrent::run(&m_pool, [profile, target]() {
+        BootTrigger trigger;
+        return trigger.run(profile, target);
+    }));
+}
@@ -0,0 +1,73 @@
+#ifndef DEVICESERVICE_H
+#define DEVICESERVICE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QJsonArray>
+#include <QThreadPool>
+#include <QFutureWatcher>
+#include <QTimer>
+#include "bootloader.h"
+#include "boottrigger.h"
+
+typedef struct {
+    Bootloader *bootloader;     //nullptr if the device could not be opened
+    int version;
+} ConnectResult;
+
+//Everything that touches the OS device lists or waits on a device before a
+//job starts.  Work runs in order on one background thread so the window never
+//blocks on a SetupAPI scan or a boot info timeout.  Results are cached and
+//signalled back on the GUI thread.
+class DeviceService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DeviceService(QObject *parent = nullptr);
+    ~DeviceService();
+    void loadFamilies();
+    void scanPorts();
+    //Rescan ports periodically, portsChanged only fires on a change
+    void watchPorts(bool enable);
+    enum PortKind {SERIAL_PORTS, CAN_INTERFACES};
+    void setPortKind(PortKind kind);
+    PortKind portKind() const {return m_portKind;}
+    void connectHid(uint16_t vid, uint16_t pid);
+#ifdef Q_OS_LINUX
+    //A silent node holds the boot info read for its whole timeout
+    void connectCan(QString interface, bool canFd, uint32_t startAddress, uint16_t eraseBlockSize);
+#endif
+    //Runs a bootloader entry profile against the target, see BootTrigger
+    void triggerBootloader(const QJsonObject &profile, const QJsonObject &target);
+    bool isConnecting() const {return m_connecting || m_triggering;}
+    const QJsonArray &families() const {return m_families;}
+    const QJsonArray &triggers() const {return m_triggers;}
+    const QStringList &ports() const {return m_ports;}
+signals:
+    void familiesLoaded();
+    void portsChanged();
+    //Receiver takes ownership of the bootloader
+    void hidConnected(Bootloader *bootloader, int version);
+    void canConnected(Bootloader *bootloader, int version);
+    void bootloaderTriggered(bool success, QString report);
+private:
+    enum {PORT_SCAN_INTERVAL_MS = 2000};
+    QThreadPool m_pool;
+    QTimer m_portTimer;
+    QJsonArray m_families;
+    QJsonArray m_triggers;
+    QStringList m_ports;
+    bool m_scanning;
+    bool m_connecting;
+    bool m_connectingCan;       //which of the connected signals ends the connect
+    bool m_triggering;
+    PortKind m_portKind;
+    PortKind m_scanKind;
+    QFutureWatcher<QJsonObject> m_familiesWatcher;
+    QFutureWatcher<QStringList> m_portsWatcher;
+    QFutureWatcher<ConnectResult> m_connectWatcher;
+    QFutureWatcher<TriggerResult> m_triggerWatcher;
+    static QJsonObject readDevices();
+};
+
+#endif // DEVICESERVICE_H
@@ -0,0 +1,46 @@
+#include "elffile.h"
+#include <QFile>
+#include "familypolicy.h"
+
+ElfFile::ElfFile()
+{
+
+}
+
+bool ElfFile::loadElf(QString elfFileName, FirmwareImage &image, bool physicalAddresses)
+{
+    QFile elfFile(elfFileName);
+    if (!elfFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 fileSize = elfFile.size();
+    const uint8_t *file = elfFile.map(0, fileSize);
+    if (file == nullptr || fileSize < (qint64)sizeof(ElfHeader)) {
+        return false;
+    }
+    const ElfHeader *header = (const ElfHeader *)file;
+    if (memcmp(header->ident, "\x7f" "ELF", 4) != 0 || header->ident[4] != ELFCLASS32
+            || header->ident[5] != ELFDATA2LSB || header->phentsize < sizeof(ProgramHeader)
+            || header->phoff + (qint64)header->phnum * header->phentsize > fileSize) {
+        return false;
+    }
+    image.clear();
+    for (int i = 0; i < header->phnum; ++i) {
+        const ProgramHeader *ph = (const ProgramHeader *)(file + header->phoff + i * header->phentsize);
+        if (ph->type != PT_LOAD || ph->filesz == 0) {
+            continue;
+        }
+        if ((qint64)ph->offset + ph->filesz > fileSize) {
+            return false;
+        }
+        //Load address is the flash copy of initialized data, not its RAM address.
+        //PIC32 links to KSEG0/KSEG1 virtual addresses, the same adjustment
+        //HidBootloader::readCRC makes in the other direction.
+        uint32_t address = ph->paddr;
+        if (physicalAddresses) {
+            address &= FamilyPolicy::PIC32_PHYSICAL_MASK;
+        }
+        image.addData(address, QByteArray((const char *)file + ph->offset, ph->filesz));
+    }
+    return !image.isEmpty();
+}
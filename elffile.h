@@ -0,0 +1,44 @@
+#ifndef ELFFILE_H
+#define ELFFILE_H
+
+#include <QString>
+#include "firmwareimage.h"
+
+//Loads the PT_LOAD segments of a 32 bit little endian ELF file (PIC32 and ARM)
+//straight from a memory mapped file.
+class ElfFile
+{
+public:
+    ElfFile();
+    static bool loadElf(QString elfFileName, FirmwareImage &image, bool physicalAddresses = false);
+private:
+    typedef struct __attribute__ ((packed)) {
+        uint8_t ident[16];
+        uint16_t type;
+        uint16_t machine;
+        uint32_t version;
+        uint32_t entry;
+        uint32_t phoff;
+        uint32_t shoff;
+        uint32_t flags;
+        uint16_t ehsize;
+        uint16_t phentsize;
+        uint16_t phnum;
+        uint16_t shentsize;
+        uint16_t shnum;
+        uint16_t shstrndx;
+    } ElfHeader;
+    typedef struct __attribute__ ((packed)) {
+        uint32_t type;
+        uint32_t offset;
+        uint32_t vaddr;
+        uint32_t paddr;
+        uint32_t filesz;
+        uint32_t memsz;
+        uint32_t flags;
+        uint32_t align;
+    } ProgramHeader;
+    enum {ELFCLASS32 = 1, ELFDATA2LSB = 1, PT_LOAD = 1};
+};
+
+#endif // ELFFILE_H
@@ -0,0 +1,70 @@
+# Flashing engine shared by the GUI and the C API library (capi/).
+# Everything here is free of widgets so it can be embedded.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/allocationcounter.cpp \
+    $$PWD/bootloader.cpp \
+    $$PWD/boottrigger.cpp \
+    $$PWD/canceltoken.cpp \
+    $$PWD/crc.cpp \
+    $$PWD/elffile.cpp \
+    $$PWD/familypolicy.cpp \
+    $$PWD/firmwareimage.cpp \
+    $$PWD/flashplan.cpp \
+    $$PWD/hexfile.cpp \
+    $$PWD/hidbootloader.cpp \
+    $$PWD/hidprotocol.cpp \
+    $$PWD/hidsimulator.cpp \
+    $$PWD/imagebuilder.cpp \
+    $$PWD/imagecache.cpp \
+    $$PWD/imagestream.cpp \
+    $$PWD/lzblock.cpp \
+    $$PWD/realtime.cpp \
+    $$PWD/srecfile.cpp \
+    $$PWD/tracerecorder.cpp \
+    $$PWD/tracereplay.cpp \
+    $$PWD/target/lz_decode.c \
+    $$PWD/uartbootloader.cpp \
+    $$PWD/uartsimulator.cpp
+
+HEADERS += \
+    $$PWD/allocationcounter.h \
+    $$PWD/bootloader.h \
+    $$PWD/bootloaderusblink.h \
+    $$PWD/boottrigger.h \
+    $$PWD/canceltoken.h \
+    $$PWD/crc.h \
+    $$PWD/elffile.h \
+    $$PWD/familypolicy.h \
+    $$PWD/firmwareimage.h \
+    $$PWD/flashplan.h \
+    $$PWD/hexfile.h \
+    $$PWD/hidbootloader.h \
+    $$PWD/hidlink.h \
+    $$PWD/hidprotocol.h \
+    $$PWD/hidsimulator.h \
+    $$PWD/imagebuilder.h \
+    $$PWD/imagecache.h \
+    $$PWD/imagestream.h \
+    $$PWD/lzblock.h \
+    $$PWD/realtime.h \
+    $$PWD/srecfile.h \
+    $$PWD/tracerecorder.h \
+    $$PWD/tracereplay.h \
+    $$PWD/target/lz_decode.h \
+    $$PWD/uartbootloader.h \
+    $$PWD/uartsimulator.h
+
+# The USB HID link talks to SetupAPI on Windows and hidraw on Linux
+win32 {
+    SOURCES += $$PWD/bootloaderusblink.cpp
+    LIBS += -lhid -lsetupapi -luser32
+}
+
+linux {
+    SOURCES += $$PWD/bootloaderusblink_linux.cpp
+    SOURCES += $$PWD/canbootloader.cpp $$PWD/cansimulator.cpp $$PWD/cansocket.cpp $$PWD/posixserialport.cpp
+    HEADERS += $$PWD/canbootloader.h $$PWD/cansimulator.h $$PWD/cansocket.h $$PWD/posixserialport.h
+}
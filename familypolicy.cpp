@@ -0,0 +1,9 @@
+#include "familypolicy.h"
+#include "bootloader.h"
+
+const FamilyPolicy &FamilyPolicy::forFamily(int family)
+{
+    static constexpr FamilyPolicy pic32 = {true, PIC32_PHYSICAL_MASK, 0x80000000};
+    static constexpr FamilyPolicy other = {false, 0xffffffff, 0};
+    return family == Bootloader::PIC32 ? pic32 : other;
+}
@@ -0,0 +1,19 @@
+#ifndef FAMILYPOLICY_H
+#define FAMILYPOLICY_H
+
+#include <stdint.h>
+
+//Address handling that differs between device families.  One constant
+//policy per family, picked once when the family is set, so transfers apply
+//it without testing the family on every command.
+struct FamilyPolicy
+{
+    static constexpr uint32_t PIC32_PHYSICAL_MASK = 0x1fffffff;
+    bool physicalAddresses;     //images are loaded at physical addresses
+    uint32_t physicalMask;      //virtual to physical
+    uint32_t crcAddressOffset;  //READ_CRC takes KSEG0 addresses on PIC32
+    constexpr uint32_t crcAddress(uint32_t address) const {return address + crcAddressOffset;}
+    static const FamilyPolicy &forFamily(int family);
+};
+
+#endif // FAMILYPOLICY_H
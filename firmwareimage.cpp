@@ -0,0 +1,95 @@
+#include "firmwareimage.h"
+#include <iterator>
+
+FirmwareImage::FirmwareImage()
+{
+
+}
+
+void FirmwareImage::addData(uint32_t address, const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+    uint32_t start = address;
+    uint32_t end = address + data.size();
+    auto it = m_segments.upperBound(address);
+    if (it != m_segments.begin()) {
+        auto prev = std::prev(it);
+        uint32_t prevEnd = prev.key() + prev.value().size();
+        if (prevEnd == address && (it == m_segments.end() || it.key() > end)) {
+            //Common case when loading records in order
+            prev.value().append(data);
+            return;
+        }
+        if (prevEnd >= address) {
+            it = prev;
+        }
+    }
+    QByteArray merged = data;
+    while (it != m_segments.end() && it.key() <= end) {
+        uint32_t segStart = it.key();
+        uint32_t segEnd = segStart + it.value().size();
+        if (segStart < start) {
+            merged.prepend(it.value().left(start - segStart));
+            start = segStart;
+        }
+        if (segEnd > end) {
+            merged.append(it.value().mid(end - segStart));
+            end = segEnd;
+        }
+        it = m_segments.erase(it);
+    }
+    m_segments.insert(start, merged);
+}
+
+uint32_t FirmwareImage::startAddress() const
+{
+    if (m_segments.isEmpty()) {
+        return 0;
+    }
+    return m_segments.firstKey();
+}
+
+uint32_t FirmwareImage::endAddress() const
+{
+    if (m_segments.isEmpty()) {
+        return 0;
+    }
+    return m_segments.lastKey() + m_segments.last().size();
+}
+
+uint32_t FirmwareImage::dataSize() const
+{
+    uint32_t size = 0;
+    for (auto &i : m_segments) {
+        size += i.size();
+    }
+    return size;
+}
+
+QByteArray FirmwareImage::flatten(uint32_t start, uint32_t blockSize) const
+{
+    //Contiguous copy from start to the end of the image, gaps filled with 0xff
+    //and padded out to a whole number of blocks
+    uint32_t end = endAddress();
+    if (end <= start) {
+        return QByteArray();
+    }
+    uint32_t len = end - start;
+    if (blockSize > 0 && len % blockSize) {
+        len += blockSize - len % blockSize;
+    }
+    QByteArray flat(len, (char)0xff);
+    for (auto it = m_segments.cbegin(); it != m_segments.cend(); ++it) {
+        uint32_t segStart = it.key();
+        uint32_t segEnd = segStart + it.value().size();
+        if (segEnd <= start) {
+            continue;
+        }
+        uint32_t offset = segStart > start ? segStart - start : 0;
+        uint32_t skip = segStart > start ? 0 : start - segStart;
+        memcpy(flat.data() + offset, it.value().constData() + skip, it.value().size() - skip);
+    }
+    return flat;
+}
@@ -0,0 +1,25 @@
+#ifndef FIRMWAREIMAGE_H
+#define FIRMWAREIMAGE_H
+
+#include <QMap>
+#include <QByteArray>
+
+//Sparse flash image.  Segments are keyed by start address and never overlap
+//or touch; adjacent data is coalesced into a single segment.
+class FirmwareImage
+{
+public:
+    FirmwareImage();
+    void addData(uint32_t address, const QByteArray &data);
+    void clear() {m_segments.clear();}
+    bool isEmpty() const {return m_segments.isEmpty();}
+    const QMap<uint32_t, QByteArray> &segments() const {return m_segments;}
+    uint32_t startAddress() const;
+    uint32_t endAddress() const;
+    uint32_t dataSize() const;
+    QByteArray flatten(uint32_t start, uint32_t blockSize) const;
+private:
+    QMap<uint32_t, QByteArray> m_segments;
+};
+
+#endif // FIRMWAREIMAGE_H
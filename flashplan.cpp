@@ -0,0 +1,154 @@
+#include "flashplan.h"
+#include "bootloader.h"
+#include "hidbootloader.h"
+#include "uartbootloader.h"
+#include "imagebuilder.h"
+#include "imagecache.h"
+#include "tracereplay.h"
+
+FlashPlan::FlashPlan() : m_link{115200, 1.0, HidLink::DEFAULT_REPORT_SIZE, 2.0, 20.0, 0},
+    m_eraseBlockSize(0), m_dataSize(0), m_hidValid(false), m_hidFrames(0), m_hidReports(0),
+    m_hidFramedBytes(0), m_uartBlocks(0), m_uartPaddedBytes(0), m_uartBytesSent(0),
+    m_hidEstimate{0, 0, 0}, m_uartEstimate{0, 0, 0}
+{
+
+}
+
+bool FlashPlan::analyse(QString fileNames, int family, uint32_t startAddress, uint32_t eraseBlockSize,
+                        const LinkProfile &link)
+{
+    m_link = link;
+    m_eraseBlockSize = eraseBlockSize;
+    m_regions.clear();
+    if (eraseBlockSize == 0) {
+        m_error = "Invalid erase block size";
+        return false;
+    }
+    //Bin files load at the start address, the same as the paged bootloaders
+    QStringList files = ImageBuilder::splitFileList(fileNames);
+    for (auto &i : files) {
+        if (i.endsWith(".bin", Qt::CaseInsensitive)) {
+            i += QString("@%1").arg(startAddress, 0, 16);
+        }
+    }
+    QStringList errors;
+    std::shared_ptr<const CachedImage> cached = ImageCache::instance().get(files.join(";"),
+            FamilyPolicy::forFamily(family).physicalAddresses, eraseBlockSize, &errors);
+    if (!cached || cached->image.isEmpty()) {
+        m_error = errors.isEmpty() ? "Image is empty" : errors.join("; ");
+        return false;
+    }
+    const FirmwareImage &image = cached->image;
+    m_dataSize = image.dataSize();
+    uint32_t hidEraseBlocks = 0;
+    const QMap<uint32_t, QByteArray> &segments = image.segments();
+    for (auto it = segments.cbegin(); it != segments.cend(); ++it) {
+        uint32_t first = it.key() / eraseBlockSize;
+        uint32_t last = (it.key() + it.value().size() - 1) / eraseBlockSize;
+        PlanRegion region = {it.key(), (uint32_t)it.value().size(), last - first + 1, 0};
+        region.fill = (double)region.length / ((double)region.eraseBlocks * eraseBlockSize);
+        hidEraseBlocks += region.eraseBlocks;
+        m_regions.append(region);
+    }
+
+    //HID: run the real packing over a link that never transmits, so report
+    //sizes and escaping are counted exactly
+    HidBootloader hid(new TraceReplayLink(QList<TraceFrame>(), HidLink::DEFAULT_REPORT_SIZE, link.hidReportSize));
+    hid.setFamily(family);
+    m_hidValid = hid.setFile(fileNames) && hid.frameStats(m_hidFrames, m_hidReports, m_hidFramedBytes);
+    if (link.appLength > 0) {
+        hidEraseBlocks = (link.appLength + eraseBlockSize - 1) / eraseBlockSize;
+    }
+    m_hidEstimate.eraseMs = hidEraseBlocks * link.eraseBlockMs;
+    m_hidEstimate.programMs = m_hidFrames * link.hidFrameMs;
+    m_hidEstimate.verifyMs = m_regions.size() * link.hidFrameMs;
+
+    //UART: a flat copy from the image start padded to whole blocks, each
+    //block erased and programmed by its own DATA command
+    uint32_t span = image.endAddress() - image.startAddress();
+    m_uartBlocks = (span + eraseBlockSize - 1) / eraseBlockSize;
+    m_uartPaddedBytes = m_uartBlocks * eraseBlockSize - m_dataSize;
+    uint32_t blockBytes = sizeof(TxHeader) + 4 + eraseBlockSize;
+    m_uartBytesSent = (uint64_t)m_uartBlocks * blockBytes + 2 * (sizeof(TxHeader) + 8);
+    double byteMs = link.baud > 0 ? 10000.0 / link.baud : 0;
+    m_uartEstimate.eraseMs = m_uartBlocks * link.eraseBlockMs;
+    m_uartEstimate.programMs = m_uartBlocks * (blockBytes * byteMs + link.uartRttMs) + link.uartRttMs;
+    m_uartEstimate.verifyMs = link.uartRttMs;
+    m_error.clear();
+    return true;
+}
+
+double FlashPlan::total(const PlanEstimate &estimate)
+{
+    return estimate.eraseMs + estimate.programMs + estimate.verifyMs;
+}
+
+QStringList FlashPlan::warnings() const
+{
+    QStringList warnings;
+    if (m_uartBlocks > 0 && m_uartPaddedBytes > m_uartBlocks * m_eraseBlockSize / 2) {
+        warnings.append(QString("UART sends %1% padding, gaps between regions go out as 0xff")
+                        .arg(100.0 * m_uartPaddedBytes / (m_uartBlocks * m_eraseBlockSize), 0, 'f', 0));
+    }
+    int sparse = 0;
+    for (auto &i : m_regions) {
+        if (i.eraseBlocks > 1 && i.fill < 0.5) {
+            ++sparse;
+        }
+    }
+    if (sparse > 0) {
+        warnings.append(QString("%1 regions fill less than half of their erase blocks").arg(sparse));
+    }
+    if (m_regions.size() > 16) {
+        warnings.append(QString("%1 regions, each costs a READ_CRC round trip to verify").arg(m_regions.size()));
+    }
+    if (m_hidValid && m_hidReports > 0 && m_hidFramedBytes < m_hidReports * (uint32_t)m_link.hidReportSize / 2) {
+        warnings.append("HID reports are less than half full, the image is fragmented into short records");
+    }
+    return warnings;
+}
+
+QString FlashPlan::summary() const
+{
+    return QString("%1 bytes in %2 regions, about %3 s over USB and %4 s over UART at %5 baud")
+            .arg(m_dataSize).arg(m_regions.size())
+            .arg(total(m_hidEstimate) / 1000, 0, 'f', 1).arg(total(m_uartEstimate) / 1000, 0, 'f', 1)
+            .arg(m_link.baud);
+}
+
+QString FlashPlan::report() const
+{
+    QStringList lines;
+    lines.append("Regions:");
+    for (auto &i : m_regions) {
+        lines.append(QString("  0x%1  %2 bytes  %3 erase blocks  %4% fill")
+                     .arg(i.start, 8, 16, QChar('0')).arg(i.length, 8).arg(i.eraseBlocks, 5)
+                     .arg(100 * i.fill, 5, 'f', 1));
+    }
+    lines.append("");
+    if (m_hidValid) {
+        lines.append(QString("USB HID (%1 byte reports): %2 frames, %3 reports, %4 bytes framed, %5 verify regions")
+                     .arg(m_link.hidReportSize).arg(m_hidFrames).arg(m_hidReports)
+                     .arg(m_hidFramedBytes).arg(m_regions.size()));
+    } else {
+        lines.append("USB HID: image cannot be framed for HID");
+    }
+    lines.append(QString("  erase %1 ms, program %2 ms, verify %3 ms (%4 ms per frame)")
+                 .arg(m_hidEstimate.eraseMs, 0, 'f', 0).arg(m_hidEstimate.programMs, 0, 'f', 0)
+                 .arg(m_hidEstimate.verifyMs, 0, 'f', 0).arg(m_link.hidFrameMs, 0, 'f', 2));
+    lines.append(QString("UART (%1 baud): %2 erase blocks, %3 padded bytes, %4 bytes sent, 1 verify command")
+                 .arg(m_link.baud).arg(m_uartBlocks).arg(m_uartPaddedBytes).arg(m_uartBytesSent));
+    lines.append(QString("  erase %1 ms, program %2 ms, verify %3 ms (%4 ms round trip, no compression)")
+                 .arg(m_uartEstimate.eraseMs, 0, 'f', 0).arg(m_uartEstimate.programMs, 0, 'f', 0)
+                 .arg(m_uartEstimate.verifyMs, 0, 'f', 0).arg(m_link.uartRttMs, 0, 'f', 2));
+    lines.append(QString("Erase times use %1 ms per %2 byte block").arg(m_link.eraseBlockMs).arg(m_eraseBlockSize));
+    QStringList warn = warnings();
+    if (!warn.isEmpty()) {
+        lines.append("");
+        lines.append("Warnings:");
+        for (auto &i : warn) {
+            lines.append("  " + i);
+        }
+    }
+    return lines.join("\n");
+}
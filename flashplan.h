@@ -0,0 +1,64 @@
+#ifndef FLASHPLAN_H
+#define FLASHPLAN_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+    uint32_t eraseBlocks;   //erase blocks the region touches
+    double fill;            //share of those blocks the region fills
+} PlanRegion;
+
+typedef struct {
+    int baud;
+    double uartRttMs;       //UART command round trip, measured or assumed
+    int hidReportSize;      //HID output report payload
+    double hidFrameMs;      //HID frame round trip including programming
+    double eraseBlockMs;    //per erase block, from devices.json
+    uint32_t appLength;     //range HID ERASE_FLASH clears, 0 to use the image
+} LinkProfile;
+
+typedef struct {
+    double eraseMs;
+    double programMs;
+    double verifyMs;
+} PlanEstimate;
+
+//What flashing an image costs on each link, worked out from the parsed image
+//without a device: region layout, the frames and reports HidBootloader would
+//send, the blocks UARTBootloader would send and a wall time for each.
+class FlashPlan
+{
+public:
+    FlashPlan();
+    bool analyse(QString fileNames, int family, uint32_t startAddress, uint32_t eraseBlockSize,
+                 const LinkProfile &link);
+    QString errorString() const {return m_error;}
+    const QList<PlanRegion> &regions() const {return m_regions;}
+    const PlanEstimate &hidEstimate() const {return m_hidEstimate;}
+    const PlanEstimate &uartEstimate() const {return m_uartEstimate;}
+    QStringList warnings() const;
+    QString summary() const;
+    QString report() const;
+private:
+    QString m_error;
+    LinkProfile m_link;
+    uint32_t m_eraseBlockSize;
+    uint32_t m_dataSize;
+    QList<PlanRegion> m_regions;
+    bool m_hidValid;
+    int m_hidFrames;
+    int m_hidReports;
+    uint32_t m_hidFramedBytes;
+    uint32_t m_uartBlocks;
+    uint32_t m_uartPaddedBytes;
+    uint64_t m_uartBytesSent;
+    PlanEstimate m_hidEstimate;
+    PlanEstimate m_uartEstimate;
+    static double total(const PlanEstimate &estimate);
+};
+
+#endif // FLASHPLAN_H
@@ -78,6 +78,25 @@ uint8_t *HexRecord::data()
     return &m_binary[4];
 }
 
+int HexRecord::build(uint8_t *binary, uint8_t type, uint16_t address, const uint8_t *data, uint8_t len)
+{
+    //Binary form of a record as sent to the HID bootloader: length, address,
+    //type, data and checksum
+    binary[0] = len;
+    binary[1] = address >> 8;
+    binary[2] = address & 0xff;
+    binary[3] = type;
+    if (len > 0) {
+        memcpy(&binary[4], data, len);
+    }
+    uint8_t checksum = 0;
+    for (int i = 0; i < len + 4; ++i) {
+        checksum += binary[i];
+    }
+    binary[len + 4] = -checksum;
+    return len + 5;
+}
+
 uint8_t HexRecord::hexCharToInt(char c)
 {
     if (c >= '0' && c <= '9') {
@@ -159,3 +178,37 @@ std::unique_ptr<QFile> HexFile::hexToBinFile(QString hexFileName, uint32_t &star
     binFile->close();
     return nullptr;
 }
+
+bool HexFile::loadHex(QString hexFileName, FirmwareImage &image)
+{
+    QFile hexFile(hexFileName);
+    if (!hexFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    uint32_t linAddress = 0;
+    uint32_t segAddress = 0;
+    char lineBuffer[265];
+    image.clear();
+    while (hexFile.readLine(lineBuffer, 265) > 0) {
+        HexRecord rec(lineBuffer);
+        if (!rec.isValid()) {
+            continue;
+        }
+        switch(rec.recType()) {
+        case HexRecord::HEX_LIN_ADDRESS:
+            linAddress = rec.address();
+            break;
+        case HexRecord::HEX_SEG_ADDRESS:
+            segAddress = rec.address();
+            break;
+        case HexRecord::HEX_DATA:
+            image.addData(rec.address() + segAddress + linAddress,
+                          QByteArray((char *)rec.data(), rec.dataLength()));
+            break;
+        case HexRecord::HEX_EOF:
+            return true;
+        }
+    }
+    //EOF record is missing so the hex file is probably invalid
+    return false;
+}
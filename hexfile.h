@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QFile>
+#include "firmwareimage.h"
 
 class HexRecord
 {
@@ -15,6 +16,7 @@ public:
     int recLength();
     uint8_t* data();
     bool isValid() {return m_valid;}
+    static int build(uint8_t *binary, uint8_t type, uint16_t address, const uint8_t *data, uint8_t len);
     enum {HEX_DATA = 0, HEX_EOF = 1, HEX_SEG_ADDRESS = 2, HEX_LIN_ADDRESS = 4, HEX_INVALID = 0xff};
 private:
     uint8_t m_binary[260];
@@ -27,6 +29,7 @@ class HexFile
 public:
     HexFile();
     static std::unique_ptr<QFile> hexToBinFile(QString hexFileName, uint32_t &startAddress, QString binFileName = "");
+    static bool loadHex(QString hexFileName, FirmwareImage &image);
 };
 
 #endif // HEXFILE_H
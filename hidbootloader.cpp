@@ -1,12 +1,34 @@
 #include "hidbootloader.h"
 #include "hexfile.h"
+#include "crc.h"
+#include "allocationcounter.h"
+#include "imagestream.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QtConcurrent/QtConcurrent>
 
 HidBootloader::HidBootloader(uint16_t vid, uint16_t pid):
-    Bootloader(), m_link(std::unique_ptr<BootLoaderUSBLink>(new BootLoaderUSBLink())),
-    m_sectionCRC(0), m_sectionStartAddress(0), m_currentAddress(0),
-    m_linAddress(0), m_segAddress(0)
+    Bootloader(), m_prepareStarted(false), m_streaming(false), m_pendingLen(0), m_frameRttMs(0), m_blankCheckStart(0), m_blankCheckLength(0)
 {
-    m_link->Open(pid, vid);
+    BootLoaderUSBLink *link = new BootLoaderUSBLink();
+    link->Open(pid, vid);
+    m_link.reset(link);
+    m_link->setCancelToken(&m_cancel);
+}
+
+HidBootloader::HidBootloader(HidLink *link):
+    Bootloader(), m_link(link), m_prepareStarted(false), m_streaming(false), m_pendingLen(0), m_frameRttMs(0), m_blankCheckStart(0), m_blankCheckLength(0)
+{
+    m_link->setCancelToken(&m_cancel);
+}
+
+HidBootloader::~HidBootloader()
+{
+    if (m_prepared.isRunning()) {
+        m_prepared.waitForFinished();
+    }
 }
 
 bool HidBootloader::isConnected()
@@ -14,50 +36,74 @@ bool HidBootloader::isConnected()
     return m_link->Connected();
 }
 
+template<class Cmd>
+bool HidBootloader::command(const typename Cmd::Request &request, typename Cmd::Reply &reply, int wait_ms)
+{
+    typename Cmd::Frame frame;
+    int len = HidProtocol::encode<Cmd>(request, frame);
+    return transferFrame(frame, len, wait_ms)
+            && HidProtocol::decode<Cmd>(m_report, m_link->inputReportSize(), reply);
+}
+
 int HidBootloader::readBootInfo()
 {
-    uint16_t version = 0;
-    m_transferBuffer[0] = READ_BOOT_INFO;
-    m_bufferLen = 1;
-    processOutput();
-    m_link->WriteDevice(m_processedBuffer, 1);
-    m_link->ReadDevice(m_transferBuffer);
-    m_bufferLen = 64;
-    m_bufferLen = processInput();
-    if (m_bufferLen != 3) {
-        version = 0;
-    } else {
-        version = (m_processedBuffer[1] << 8) + m_processedBuffer[2];
+    HidProtocol::ReadBootInfo::Request request = {HidProtocol::ReadBootInfo::code};
+    HidProtocol::ReadBootInfo::Reply reply;
+    if (!command<HidProtocol::ReadBootInfo>(request, reply)) {
+        return 0;
     }
-    return version;
+    return (reply[1] << 8) + reply[2];
 }
 
 bool HidBootloader::setFile(QString fileName)
 {
-    if (!fileName.endsWith(".hex", Qt::CaseInsensitive)) {
-        return false;
+    //Only check the files here.  Parsing and framing run in the background
+    //during the blank check, see prepare(), and eraseFlash() waits for them.
+    if (m_prepared.isRunning()) {
+        m_prepared.waitForFinished();
     }
-    m_hexFile.reset(new QFile());
-    m_hexFile->setFileName(fileName);
-    if (m_hexFile->open(QIODevice::ReadOnly | QIODevice::Text)) {
+    m_streaming = ImageStream::isStream(fileName);
+    if (m_streaming) {
+        //Nothing to check or prepare, it is read while programming
+        if (!m_stream) {
+            m_stream.reset(new ImageStream());
+        }
+        m_fileName = fileName;
+        m_prepareStarted = false;
         return true;
-    } else {
-        m_hexFile = nullptr;
-        return false;
     }
+    QStringList files = ImageBuilder::splitFileList(fileName);
+    for (auto &i : files) {
+        if (!QFileInfo(i.section('@', 0, 0)).isReadable()) {
+            return false;
+        }
+    }
+    m_fileName = fileName;
+    m_prepareStarted = false;
+    return !files.isEmpty();
 }
 
 bool HidBootloader::eraseFlash()
 {
+    startPrepare();
+    //Read back while the image is parsed, but only trusted once the image
+    //is known to fit in the range that was checked
+    bool blank = m_blankCheckLength > 0 && !m_streaming && isBlank();
+    //A file that does not parse or has overlapping regions must not cost
+    //the application already on the device
+    if (!m_streaming && !waitPrepared()) {
+        emit finished(false);
+        return false;
+    }
+    if (blank && imageInBlankRange()) {
+        emit message("Device is blank, erase skipped");
+        emit progress(50);
+        return true;
+    }
     emit message("Erasing device");
-    m_transferBuffer[0] = ERASE_FLASH;
-    m_bufferLen = 1;
-    processOutput();
-    m_link->WriteDevice(m_processedBuffer, 1);
-    m_link->ReadDevice(m_transferBuffer, 30000);
-    m_bufferLen = 64;
-    m_bufferLen = processInput();
-    if (m_bufferLen != 1 || m_processedBuffer[0] != ERASE_FLASH) {
+    HidProtocol::EraseFlash::Request request = {HidProtocol::EraseFlash::code};
+    HidProtocol::EraseFlash::Reply reply;
+    if (!command<HidProtocol::EraseFlash>(request, reply, 30000)) {
         emit finished(false);
         return false;
     } else {
@@ -69,189 +115,428 @@ bool HidBootloader::eraseFlash()
 
 bool HidBootloader::programFlash()
 {
-    if (!m_hexFile) {
-        return false;
+    if (m_streaming) {
+        return programStream();
     }
-    int lineCount = 0;
-    char lineBuffer[265];
-    m_hexFile->reset();
-    //Count lines so we can calculate progress
-    while (m_hexFile->readLine(lineBuffer, sizeof (lineBuffer)) > 0) {
-        ++lineCount;
-    }
-    if (lineCount == 0) {
+    if (!waitPrepared()) {
+        emit finished(false);
         return false;
     }
-    m_hexFile->reset();
-    int currentLine = 0;
+    uint32_t totalBytes = m_image.dataSize();
+    uint32_t bytesSent = 0;
     emit message("Programming flash");
-    m_regionList.clear();
-    uint32_t recordAddress;
-    while (m_hexFile->readLine(lineBuffer, sizeof (lineBuffer)) > 0) {
-        if (m_abort) {
+    QElapsedTimer frameClock;
+    frameClock.start();
+    HidProtocol::ProgramFlash::Reply reply;
+    uint8_t *frames = (uint8_t *)m_frames.data();
+    int percent = -1;
+    //Everything the loop touches was built by prepare(), it only reads frames
+    //out and reports into m_report
+    NoAllocationScope steady("HID program loop");
+    for (auto &i : m_frameList) {
+        if (m_cancel.isCancelled()) {
             emit finished(false);
             return false;
         }
-        HexRecord hex(lineBuffer);
-        if (hex.isValid()) {
-            switch (hex.recType()) {
-            case HexRecord::HEX_LIN_ADDRESS:
-                m_linAddress = hex.address();
-                break;
-            case HexRecord::HEX_SEG_ADDRESS:
-                m_segAddress = hex.address();
-                break;
-            case HexRecord::HEX_DATA:
-                recordAddress = hex.address() + m_segAddress + m_linAddress;
-                if (recordAddress != m_currentAddress) {
-                    //save previous region
-                    FlashRegion prevRegion
-                            = {m_sectionStartAddress, m_currentAddress - m_sectionStartAddress, m_sectionCRC};
-                    m_regionList.append(prevRegion);
-                    m_sectionStartAddress = recordAddress;
-                    m_currentAddress = recordAddress;
-                    m_sectionCRC = 0;
-                }
-                m_sectionCRC = calculateCRC(hex.data(), hex.dataLength(), m_sectionCRC);
-                m_currentAddress += hex.dataLength();
-                break;
-            case HexRecord::HEX_EOF:
-                //save last region
-                FlashRegion lastRegion
-                        = {m_sectionStartAddress, m_currentAddress - m_sectionStartAddress, m_sectionCRC};
-                m_regionList.append(lastRegion);
-                break;
-            }
-            m_transferBuffer[0] = PROGRAM_FLASH;
-            memcpy(&m_transferBuffer[1], hex.toBinary(), hex.recLength());
-            m_bufferLen = hex.recLength() + 1;
-            int len = processOutput();
-            m_link->WriteDevice(m_processedBuffer, len);
-            m_link->ReadDevice(m_transferBuffer, 200);
-            m_bufferLen = 64;
-            m_bufferLen = processInput();
-            if (m_bufferLen != 1 || m_processedBuffer[0] != PROGRAM_FLASH) {
-                emit finished(false);
-                return false;
-            }
+        if (!transferFrame(frames + i.offset, i.length)
+                || !HidProtocol::decode<HidProtocol::ProgramFlash>(m_report, m_link->inputReportSize(), reply)) {
+            emit finished(false);
+            return false;
+        }
+        if (i.bytes > 0) {
+            bytesSent += i.bytes;
+            updateProgress(percent, (bytesSent * 100ULL) / totalBytes);
         }
-        ++currentLine;
-        emit progress((currentLine * 100) / lineCount);
     }
+    steady.end();
+    //Per frame including the time the device takes to program it
+    m_frameRttMs = frameClock.nsecsElapsed() / 1e6 / m_frameList.size();
     emit progress(100);
     emit finished(true);
-    m_hexFile->close();
     return true;
 }
 
-uint16_t HidBootloader::readCRC(uint32_t address, uint32_t len)
+bool HidBootloader::frameStats(int &frames, int &reports, uint32_t &framedBytes)
+{
+    if (m_streaming) {
+        return false;
+    }
+    startPrepare();
+    if (!m_prepared.result()) {
+        return false;
+    }
+    int payload = m_link->outputReportSize();
+    frames = m_frameList.size();
+    reports = 0;
+    framedBytes = 0;
+    for (auto &i : m_frameList) {
+        reports += (i.length + payload - 1) / payload;
+        framedBytes += i.length;
+    }
+    return true;
+}
+
+void HidBootloader::startPrepare()
 {
-    m_transferBuffer[0] = READ_CRC;
-    if (m_family == PIC32) {
-        address += 0x80000000;  //Adjust for virtual vs physical address
-    }
-    *(uint32_t *)&m_transferBuffer[1] = address;
-    *(uint32_t *)&m_transferBuffer[5] = len;
-    m_bufferLen = 9;
-    int outLen = processOutput();
-    m_link->WriteDevice(m_processedBuffer, outLen);
-    m_link->ReadDevice(m_transferBuffer, 500);
-    m_bufferLen = 64;
-    m_bufferLen = processInput();
-    if (m_bufferLen != 3 || m_processedBuffer[0] != READ_CRC) {
-        return -1;
-    }
-    return *(uint16_t *)&m_processedBuffer[1];
+    if (!m_prepareStarted && !m_streaming) {
+        m_prepareStarted = true;
+        m_prepared = QtConcurrent::run([this]() {return prepare();});
+    }
 }
 
-void HidBootloader::jumpToApp()
+bool HidBootloader::waitPrepared()
+{
+    //prepare() runs off the job thread, so its errors are reported from here
+    startPrepare();
+    if (!m_prepared.result()) {
+        emit message(m_prepareError);
+        return false;
+    }
+    return true;
+}
+
+bool HidBootloader::prepare()
+{
+    //Runs on a pool thread.  Only touches the image, region list and frame
+    //buffers, which the transfer side does not use until programFlash.
+    m_frames.clear();
+    m_frameList.clear();
+    m_regionList.clear();
+    m_pendingLen = 0;
+    m_prepareError.clear();
+    if (!loadImage(m_fileName, 0, &m_prepareError)) {
+        return false;
+    }
+    if (m_image.isEmpty()) {
+        m_prepareError = m_fileName + " contains no data";
+        return false;
+    }
+    m_packLimit = packLimit();
+    uint32_t linAddress = 0xffffffff;
+    int segment = 0;
+    const QMap<uint32_t, QByteArray> &segments = m_image.segments();
+    for (auto it = segments.cbegin(); it != segments.cend(); ++it) {
+        //Region CRCs come with the cached image
+        FlashRegion region = {it.key(), (uint32_t)it.value().size(), m_cachedImage->regionCRCs[segment++]};
+        m_regionList.append(region);
+        appendData(it.key(), (const uint8_t *)it.value().constData(), it.value().size(), linAddress);
+    }
+    appendRecord(HexRecord::HEX_EOF, 0, nullptr, 0, 0);
+    flushFrame();
+    return true;
+}
+
+int HidBootloader::packLimit()
 {
-    m_transferBuffer[0] = JMP_TO_APP;
-    m_bufferLen = 1;
-    int len = processOutput();
-    m_link->WriteDevice(m_processedBuffer, len);
-    m_link->ReadDevice(m_transferBuffer);
+    //Classic 64 byte reports carry one record per frame, which is what every
+    //bootloader expects.  High speed devices with larger reports get as many
+    //records as fit in one report so each USB round trip moves more data.
+    return m_link->outputReportSize() > HidLink::DEFAULT_REPORT_SIZE ?
+                qMin((int)m_link->outputReportSize(), (int)HidLink::MAX_REPORT_SIZE) : 0;
 }
 
-int HidBootloader::processOutput()
+void HidBootloader::appendData(uint32_t address, const uint8_t *data, uint32_t length, uint32_t &linAddress)
 {
-    int outPos = 0;
-    //append crc to buffer
-    uint16_t crc = calculateCRC(m_transferBuffer, m_bufferLen);
-    m_transferBuffer[m_bufferLen++] = crc & 0xff;
-    m_transferBuffer[m_bufferLen++] = (crc >> 8) & 0xff;
-    //add header and escape special values
-    m_processedBuffer[outPos++] = SOH;
-    for (int i = 0; i < m_bufferLen; ++i) {
-        if (m_transferBuffer[i] == SOH || m_transferBuffer[i] == EOT || m_transferBuffer[i] == DLE) {
-            m_processedBuffer[outPos++] = DLE;
+    while (length > 0) {
+        if ((address & 0xffff0000) != linAddress) {
+            linAddress = address & 0xffff0000;
+            uint8_t upper[2] = {(uint8_t)(linAddress >> 24), (uint8_t)(linAddress >> 16)};
+            appendRecord(HexRecord::HEX_LIN_ADDRESS, 0, upper, 2, 0);
         }
-        m_processedBuffer[outPos++] = m_transferBuffer[i];
+        //Keep records aligned the same way a compiler generated hex file is
+        uint32_t len = RECORD_DATA_SIZE - (address % RECORD_DATA_SIZE);
+        if (len > length) {
+            len = length;
+        }
+        appendRecord(HexRecord::HEX_DATA, address & 0xffff, data, len, len);
+        address += len;
+        data += len;
+        length -= len;
     }
-    m_processedBuffer[outPos++] = EOT;
-    return outPos;
 }
 
-int HidBootloader::processInput()
+bool HidBootloader::programStream()
 {
-    int outPos = 0;
-    if (m_transferBuffer[0] != SOH) {
-        return 0;
+    //The image is packed into the same frames prepare() builds, but a
+    //chunk at a time as it arrives, and the region CRCs verify() needs are
+    //summed on the way through.  Only the stream's read buffer and the
+    //frames of one chunk are held at any time.
+    ImageStream &stream = *m_stream;
+    if (!stream.open(m_fileName)) {
+        emit message(stream.errorString());
+        emit finished(false);
+        return false;
     }
-    int i = 1;
-    while (i < m_bufferLen) {
-        if (m_transferBuffer[i] == EOT) {
+    m_frames.resize(0);
+    m_frameList.resize(0);
+    m_regionList.clear();
+    m_streamBytes = 0;
+    m_pendingLen = 0;
+    m_packLimit = packLimit();
+    emit message("Programming flash from stream");
+    uint32_t linAddress = 0xffffffff;
+    uint32_t address;
+    const uint8_t *data;
+    uint8_t len;
+    int status;
+    int percent = -1;
+    qint64 nextReport = STREAM_REPORT_BYTES;
+    while ((status = stream.next(address, data, len)) == ImageStream::DATA) {
+        if (!addStreamData(address, data, len)) {
+            status = ImageStream::FAILED;
             break;
         }
-        if (m_transferBuffer[i] == DLE) {
-            ++i;
+        appendData(address, data, len, linAddress);
+        if (!sendFrames()) {
+            stream.close();
+            emit finished(false);
+            return false;
+        }
+        //Received bytes against the size given with the stream, if any
+        if (stream.expectedSize() > 0) {
+            updateProgress(percent, qMin(99LL, stream.bytesReceived() * 100 / stream.expectedSize()));
+        } else if (stream.bytesReceived() >= nextReport) {
+            emit message(QString("%1 KB received").arg(stream.bytesReceived() / 1024));
+            nextReport += STREAM_REPORT_BYTES;
         }
-        m_processedBuffer[outPos++] = m_transferBuffer[i++];
     }
-    if (m_transferBuffer[i] != EOT) {
-        return 0;
+    stream.close();
+    if (status == ImageStream::FAILED) {
+        if (!stream.errorString().isEmpty()) {
+            emit message(stream.errorString());
+        }
+        emit finished(false);
+        return false;
     }
-    uint16_t calculatedCrc = calculateCRC(m_processedBuffer, outPos - 2);
-    uint16_t receivedCrc = m_processedBuffer[outPos - 2] + (m_processedBuffer[outPos - 1] << 8);
-    if (calculatedCrc != receivedCrc) {
-        return 0;
+    appendRecord(HexRecord::HEX_EOF, 0, nullptr, 0, 0);
+    flushFrame();
+    if (!sendFrames()) {
+        emit finished(false);
+        return false;
+    }
+    emit message(QString("%1 bytes programmed from stream").arg(m_streamBytes));
+    emit progress(100);
+    emit finished(true);
+    return true;
+}
+
+bool HidBootloader::addStreamData(uint32_t address, const uint8_t *data, uint8_t len)
+{
+    //Regions are runs of consecutive addresses, as the segments of a loaded
+    //image are.  Data can arrive in any order but must not be written twice.
+    //Data continuing any region extends it, the running CRC carries on, so
+    //the list only grows with gaps in the image and stays within
+    //MAX_STREAM_REGIONS, which also bounds the overlap scan.
+    int extend = -1;
+    for (int i = m_regionList.size() - 1; i >= 0; --i) {
+        const FlashRegion &region = m_regionList[i];
+        if (address < region.startAddress + region.length && address + len > region.startAddress) {
+            emit message(QString("Stream data at 0x%1 overlaps data already programmed").arg(address, 8, 16, QChar('0')));
+            return false;
+        }
+        if (extend < 0 && region.startAddress + region.length == address) {
+            extend = i;
+        }
+    }
+    if (extend >= 0) {
+        FlashRegion &region = m_regionList[extend];
+        region.length += len;
+        region.crc = CRC::crc16(data, len, region.crc);
+    } else if (m_regionList.size() >= MAX_STREAM_REGIONS) {
+        emit message(QString("Stream data at 0x%1 starts more than %2 separate regions")
+                     .arg(address, 8, 16, QChar('0')).arg(MAX_STREAM_REGIONS));
+        return false;
     } else {
-        return outPos - 2;
+        FlashRegion region = {address, len, CRC::crc16(data, len)};
+        m_regionList.append(region);
     }
+    m_streamBytes += len;
+    return true;
 }
 
-bool HidBootloader::verify()
+bool HidBootloader::sendFrames()
 {
+    //Sends the frames completed so far, the one still being packed stays
+    HidProtocol::ProgramFlash::Reply reply;
+    for (auto &i : m_frameList) {
+        if (m_cancel.isCancelled()
+                || !transferFrame((uint8_t *)m_frames.data() + i.offset, i.length)
+                || !HidProtocol::decode<HidProtocol::ProgramFlash>(m_report, m_link->inputReportSize(), reply)) {
+            return false;
+        }
+    }
+    m_frames.resize(0);
+    m_frameList.resize(0);
+    return true;
+}
+
+void HidBootloader::appendRecord(uint8_t type, uint16_t address, const uint8_t *data, uint8_t len, uint32_t bytes)
+{
+    uint8_t record[RECORD_DATA_SIZE + 5];
+    int recordLen = HexRecord::build(record, type, address, data, len);
+    int framedLen = 0;
+    for (int i = 0; i < recordLen; ++i) {
+        framedLen += HidProtocol::needsEscape(record[i]) ? 2 : 1;
+    }
+    //SOH (1), crc (4 if both bytes need escaping) and EOT (1) around the
+    //escaped command and records, all within one report payload
+    if (m_pendingLen > 0 && (m_packLimit == 0 || m_pendingFramedLen + framedLen + 6 > m_packLimit)) {
+        flushFrame();
+    }
+    if (m_pendingLen == 0) {
+        m_pending[0] = HidProtocol::ProgramFlash::code;
+        m_pendingLen = 1;
+        m_pendingFramedLen = 1;
+        m_pendingBytes = 0;
+    }
+    memcpy(&m_pending[m_pendingLen], record, recordLen);
+    m_pendingLen += recordLen;
+    m_pendingFramedLen += framedLen;
+    m_pendingBytes += bytes;
+}
+
+void HidBootloader::flushFrame()
+{
+    uint8_t framed[HidProtocol::maxFramedLength(HidLink::MAX_REPORT_SIZE)];
+    if (m_pendingLen == 0) {
+        return;
+    }
+    FrameInfo info = {(uint32_t)m_frames.size(), (uint32_t)HidProtocol::frame(m_pending, m_pendingLen, framed), m_pendingBytes};
+    m_frames.append((const char *)framed, info.length);
+    m_frameList.append(info);
+    m_pendingLen = 0;
+}
+
+bool HidBootloader::isUpToDate()
+{
+    //Compare the region CRCs of the image with the device using READ_CRC.
+    //A stream is only known once it has been programmed.
+    if (m_streaming) {
+        return false;
+    }
+    startPrepare();
+    if (!m_prepared.result()) {
+        return false;
+    }
+    emit message("Checking device contents");
     for (auto &i : m_regionList) {
-        if (i.length > 0) {
-            uint16_t crc = readCRC(i.startAddress, i.length);
-            if (crc != i.crc) {
-                emit message("Flash verify failed");
-                return false;
-            }
+        uint16_t crc;
+        if (i.length > 0 && (!readCRC(i.startAddress, i.length, crc) || crc != i.crc)) {
+            return false;
         }
     }
-    emit message("Flash verified");
+    return !m_regionList.isEmpty();
+}
+
+void HidBootloader::setBlankCheck(uint32_t appStart, uint32_t length)
+{
+    m_blankCheckStart = appStart;
+    m_blankCheckLength = length;
+}
+
+QJsonObject HidBootloader::linkInfo()
+{
+    QJsonObject info;
+    info["input report size"] = m_link->inputReportSize();
+    info["output report size"] = m_link->outputReportSize();
+    return info;
+}
+
+bool HidBootloader::isBlank()
+{
+    //One READ_CRC over the whole application range against the CRC of the
+    //same length of 0xff.  Any failure or timeout just means erase as usual.
+    uint32_t address = m_blankCheckStart & m_policy->physicalMask;  //readCRC takes physical addresses
+    emit message("Checking for blank device");
+    uint16_t crc;
+    if (!readCRC(address, m_blankCheckLength, crc, 500 + m_blankCheckLength / 2048)) {
+        return false;
+    }
+    return crc == blankCRC(m_blankCheckLength);
+}
+
+bool HidBootloader::imageInBlankRange()
+{
+    //Anything outside the range was not checked and may hold old data
+    uint64_t start = m_blankCheckStart & m_policy->physicalMask;
+    uint64_t imageStart = m_image.startAddress() & m_policy->physicalMask;
+    uint64_t imageEnd = imageStart + (m_image.endAddress() - m_image.startAddress());
+    return imageStart >= start && imageEnd <= start + m_blankCheckLength;
+}
+
+uint16_t HidBootloader::blankCRC(uint32_t len)
+{
+    static QMutex mutex;
+    static QHash<uint32_t, uint16_t> crcs;
+    QMutexLocker lock(&mutex);
+    if (!crcs.contains(len)) {
+        uint8_t blank[1024];
+        uint16_t crc = 0;
+        memset(blank, 0xff, sizeof(blank));
+        for (uint32_t i = 0; i < len; i += sizeof(blank)) {
+            crc = CRC::crc16(blank, qMin((uint32_t)sizeof(blank), len - i), crc);
+        }
+        crcs.insert(len, crc);
+    }
+    return crcs.value(len);
+}
+
+bool HidBootloader::readCRC(uint32_t address, uint32_t len, uint16_t &crc, int wait_ms)
+{
+    HidProtocol::ReadCrc::Request request = {HidProtocol::ReadCrc::code};
+    HidProtocol::ReadCrc::Reply reply;
+    address = m_policy->crcAddress(address);
+    memcpy(&request[1], &address, 4);
+    memcpy(&request[5], &len, 4);
+    if (!command<HidProtocol::ReadCrc>(request, reply, wait_ms)) {
+        return false;
+    }
+    crc = reply[1] + (reply[2] << 8);
     return true;
 }
 
-uint16_t HidBootloader::calculateCRC(uint8_t *data, uint32_t len, uint16_t crc)
+void HidBootloader::jumpToApp()
 {
-    static const uint16_t crc_table[16] =
-    {
-        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
-        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
-    };
-    uint32_t i;
+    //Reply is not checked, the device may reset before it sends one
+    HidProtocol::JumpToApp::Request request = {HidProtocol::JumpToApp::code};
+    HidProtocol::JumpToApp::Reply reply;
+    command<HidProtocol::JumpToApp>(request, reply);
+}
 
-    while(len--)
-    {
-        i = (crc >> 12) ^ (*data >> 4);
-        crc = crc_table[i & 0x0F] ^ (crc << 4);
-        i = (crc >> 12) ^ (*data >> 0);
-        crc = crc_table[i & 0x0F] ^ (crc << 4);
-        data++;
+bool HidBootloader::transferFrame(uint8_t *buffer, int outLen, int wait_ms)
+{
+    //Send a framed command and leave the raw reply report in m_report.
+    //Nothing new goes out once cancelled so the device is never left with
+    //a command it has not seen the whole of.
+    if (m_cancel.isCancelled()) {
+        return false;
+    }
+    m_link->WriteDevice(buffer, outLen);
+    if (m_trace) {
+        m_trace->record(TraceRecorder::TX, buffer, outLen);
+    }
+    if (!m_link->ReadDevice(m_report, wait_ms)) {
+        return false;
+    }
+    if (m_trace) {
+        m_trace->record(TraceRecorder::RX, m_report, m_link->inputReportSize());
     }
+    return true;
+}
 
-    return (crc & 0xFFFF);
+bool HidBootloader::verify()
+{
+    NoAllocationScope steady("HID verify loop");
+    for (auto &i : m_regionList) {
+        if (i.length > 0) {
+            uint16_t crc;
+            if (!readCRC(i.startAddress, i.length, crc) || crc != i.crc) {
+                emit message("Flash verify failed");
+                return false;
+            }
+        }
+    }
+    steady.end();
+    emit message("Flash verified");
+    return true;
 }
@@ -2,9 +2,13 @@
 #define HIDBOOTLOADER_H
 
 #include "bootloaderusblink.h"
+#include "hidlink.h"
+#include "hidprotocol.h"
 #include "bootloader.h"
+#include "imagestream.h"
 #include <QList>
-#include <QFile>
+#include <QVector>
+#include <QFuture>
 
 typedef struct {
     uint32_t startAddress;
@@ -16,6 +20,8 @@ class HidBootloader : public Bootloader
 {
 public:
     HidBootloader(uint16_t vid, uint16_t pid);
+    HidBootloader(HidLink *link);
+    ~HidBootloader();
     virtual bool isConnected() override;
     virtual bool setFile(QString fileName) override;
     virtual int readBootInfo() override;
@@ -23,23 +29,60 @@ public:
     virtual bool programFlash() override;
     virtual void jumpToApp() override;
     virtual bool verify() override;
+    virtual bool isUpToDate() override;
+    virtual void setBlankCheck(uint32_t appStart, uint32_t length) override;
+    virtual QJsonObject linkInfo() override;
+    virtual double roundTripMs() override {return m_frameRttMs;}
+    //What programFlash sends for the file given to setFile, no device needed
+    bool frameStats(int &frames, int &reports, uint32_t &framedBytes);
 private:
-    enum {READ_BOOT_INFO = 1, ERASE_FLASH, PROGRAM_FLASH, READ_CRC, JMP_TO_APP};
-    enum {SOH = 0x01, EOT = 0x04, DLE = 0x10};
-    int processOutput(void);
-    int processInput(void);
-    uint8_t m_transferBuffer[512];
-    uint8_t m_processedBuffer[512];
-    int m_bufferLen;
-    std::unique_ptr<BootLoaderUSBLink> m_link;
-    std::unique_ptr<QFile> m_hexFile;
-    uint16_t readCRC(uint32_t address, uint32_t len);
-    uint16_t calculateCRC(uint8_t *data, uint32_t len, uint16_t crc = 0);
-    uint16_t m_sectionCRC;
-    uint32_t m_sectionStartAddress;
-    uint32_t m_currentAddress;
-    uint32_t m_linAddress;
-    uint32_t m_segAddress;
+    template<class Cmd>
+    bool command(const typename Cmd::Request &request, typename Cmd::Reply &reply, int wait_ms = 200);
+    bool transferFrame(uint8_t *buffer, int outLen, int wait_ms = 200);
+    uint8_t m_report[HidLink::MAX_REPORT_SIZE + 1];
+    enum {RECORD_DATA_SIZE = 16};
+    std::unique_ptr<HidLink> m_link;
+    typedef struct {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t bytes;     //image bytes carried, for progress
+    } FrameInfo;
+    QString m_fileName;
+    bool m_prepareStarted;
+    //Set by setFile() for stdin or a pipe, see programStream()
+    bool m_streaming;
+    std::unique_ptr<ImageStream> m_stream;
+    uint32_t m_streamBytes;
+    enum {STREAM_REPORT_BYTES = 65536};
+    //Separate address runs a stream may have, each costs a CRC read in verify()
+    enum {MAX_STREAM_REGIONS = 256};
+    QFuture<bool> m_prepared;
+    QString m_prepareError;
+    QByteArray m_frames;
+    QVector<FrameInfo> m_frameList;
+    void startPrepare();
+    bool waitPrepared();
+    bool prepare();
+    int packLimit();
+    void appendData(uint32_t address, const uint8_t *data, uint32_t length, uint32_t &linAddress);
+    bool programStream();
+    bool addStreamData(uint32_t address, const uint8_t *data, uint8_t len);
+    bool sendFrames();
+    void appendRecord(uint8_t type, uint16_t address, const uint8_t *data, uint8_t len, uint32_t bytes);
+    void flushFrame();
+    //PROGRAM_FLASH command being packed by prepare()
+    uint8_t m_pending[HidLink::MAX_REPORT_SIZE];
+    int m_pendingLen;
+    int m_pendingFramedLen;
+    uint32_t m_pendingBytes;
+    int m_packLimit;
+    double m_frameRttMs;
+    uint32_t m_blankCheckStart;
+    uint32_t m_blankCheckLength;
+    bool isBlank();
+    bool imageInBlankRange();
+    static uint16_t blankCRC(uint32_t len);
+    bool readCRC(uint32_t address, uint32_t len, uint16_t &crc, int wait_ms = 500);
     QList<FlashRegion> m_regionList;
 };
 
@@ -0,0 +1,28 @@
+#ifndef HIDLINK_H
+#define HIDLINK_H
+
+#include <stdint.h>
+
+class CancelToken;
+
+//Transport used by HidBootloader.  BootLoaderUSBLink talks to real hardware,
+//other implementations replay or simulate a device.
+class HidLink
+{
+public:
+    virtual ~HidLink() {}
+    virtual bool WriteDevice(uint8_t *buffer, int len, int wait_ms = 200) = 0;
+    virtual bool ReadDevice(uint8_t *buffer, int wait_ms = 200) = 0;
+    virtual bool Connected(void) = 0;
+    virtual void Close(void) = 0;
+    //Report sizes without the report ID byte
+    virtual int inputReportSize(void) {return DEFAULT_REPORT_SIZE;}
+    virtual int outputReportSize(void) {return DEFAULT_REPORT_SIZE;}
+    enum {DEFAULT_REPORT_SIZE = 64, MAX_REPORT_SIZE = 1024};
+    //Cancelling the token ends a pending read or write early
+    void setCancelToken(CancelToken *cancel) {m_cancel = cancel;}
+protected:
+    CancelToken *m_cancel = nullptr;
+};
+
+#endif // HIDLINK_H
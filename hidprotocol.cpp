@@ -0,0 +1,40 @@
+#include "hidprotocol.h"
+
+int HidProtocol::frame(const uint8_t *data, int len, uint8_t *out)
+{
+    int outPos = 0;
+    uint16_t crc = CRC::crc16(data, len);
+    uint8_t crcBytes[2] = {(uint8_t)(crc & 0xff), (uint8_t)((crc >> 8) & 0xff)};
+    //add header and escape special values, crc goes on the end
+    out[outPos++] = SOH;
+    for (int i = 0; i < len + 2; ++i) {
+        uint8_t c = i < len ? data[i] : crcBytes[i - len];
+        if (needsEscape(c)) {
+            out[outPos++] = DLE;
+        }
+        out[outPos++] = c;
+    }
+    out[outPos++] = EOT;
+    return outPos;
+}
+
+int HidProtocol::unframe(const uint8_t *report, int reportLength, uint8_t *out, int outSize)
+{
+    if (reportLength < 1 || report[0] != SOH) {
+        return -1;
+    }
+    int outPos = 0;
+    for (int i = 1; i < reportLength; ++i) {
+        if (report[i] == EOT) {
+            return outPos;
+        }
+        if (report[i] == DLE && ++i == reportLength) {
+            break;
+        }
+        if (outPos == outSize) {
+            break;
+        }
+        out[outPos++] = report[i];
+    }
+    return -1;
+}
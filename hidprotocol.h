@@ -0,0 +1,64 @@
+#ifndef HIDPROTOCOL_H
+#define HIDPROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+#include "crc.h"
+
+//Harmony HID bootloader framing and command set.  Fixed size commands are
+//types carrying their code and lengths, so request, frame and reply buffers
+//are sized at compile time and encode/decode cannot run past them.
+class HidProtocol
+{
+public:
+    enum {SOH = 0x01, EOT = 0x04, DLE = 0x10};
+    static constexpr bool needsEscape(uint8_t c) {return c == SOH || c == EOT || c == DLE;}
+    //SOH, every byte and the CRC escaped, EOT
+    static constexpr int maxFramedLength(int len) {return 2 * (len + 2) + 2;}
+
+    //Lengths include the command byte
+    template<uint8_t Code, int RequestLength, int ReplyLength>
+    struct Command
+    {
+        static constexpr uint8_t code = Code;
+        static constexpr int requestLength = RequestLength;
+        static constexpr int replyLength = ReplyLength;
+        typedef uint8_t Request[RequestLength];
+        typedef uint8_t Reply[ReplyLength];
+        typedef uint8_t Frame[maxFramedLength(RequestLength)];
+    };
+    typedef Command<1, 1, 3> ReadBootInfo;      //reply: major, minor
+    typedef Command<2, 1, 1> EraseFlash;
+    typedef Command<3, 1, 1> ProgramFlash;      //hex records follow the code
+    typedef Command<4, 9, 3> ReadCrc;           //address, length; reply: crc16
+    typedef Command<5, 1, 1> JumpToApp;
+
+    //Variable length frame for PROGRAM_FLASH, out must hold maxFramedLength(len)
+    static int frame(const uint8_t *data, int len, uint8_t *out);
+    //Decoded bytes including the CRC, -1 if malformed or longer than outSize
+    static int unframe(const uint8_t *report, int reportLength, uint8_t *out, int outSize);
+
+    template<class Cmd>
+    static int encode(const typename Cmd::Request &request, typename Cmd::Frame &out)
+    {
+        return frame(request, Cmd::requestLength, out);
+    }
+    //False for a malformed frame, wrong length, bad CRC or a reply to
+    //another command
+    template<class Cmd>
+    static bool decode(const uint8_t *report, int reportLength, typename Cmd::Reply &reply)
+    {
+        uint8_t payload[Cmd::replyLength + 2];
+        if (unframe(report, reportLength, payload, sizeof(payload)) != (int)sizeof(payload)) {
+            return false;
+        }
+        uint16_t crc = payload[Cmd::replyLength] + (payload[Cmd::replyLength + 1] << 8);
+        if (CRC::crc16(payload, Cmd::replyLength) != crc || payload[0] != Cmd::code) {
+            return false;
+        }
+        memcpy(reply, payload, Cmd::replyLength);
+        return true;
+    }
+};
+
+#endif // HIDPROTOCOL_H
@@ -0,0 +1,150 @@
+#include "hidsimulator.h"
+#include "hidprotocol.h"
+#include "hexfile.h"
+#include "crc.h"
+#include "allocationcounter.h"
+
+HidSimulator::HidSimulator(int reportSize) : m_reportSize(reportSize), m_escaped(false),
+    m_linAddress(0), m_reportsOut(0), m_reportsIn(0)
+{
+
+}
+
+bool HidSimulator::WriteDevice(uint8_t *buffer, int len, int wait_ms)
+{
+    (void) wait_ms;
+    //Device side, not part of the host transfer loop being checked
+    AllocationExempt device;
+    m_reportsOut += (len + m_reportSize - 1) / m_reportSize;
+    if (len > m_reportSize) {
+        //The bootloader handles one report per frame, the rest of a frame
+        //that spills over is lost and the command is never answered
+        m_rxFrame.clear();
+        m_escaped = false;
+        return true;
+    }
+    for (int i = 0; i < len; ++i) {
+        m_rxFrame.append((char)buffer[i]);
+        if (m_escaped) {
+            m_escaped = false;
+        } else if (buffer[i] == HidProtocol::DLE) {
+            m_escaped = true;
+        } else if (buffer[i] == HidProtocol::EOT) {
+            processFrame();
+            m_rxFrame.clear();
+        }
+    }
+    return true;
+}
+
+bool HidSimulator::ReadDevice(uint8_t *buffer, int wait_ms)
+{
+    //Nothing to send is a timeout, without waiting for it
+    (void) wait_ms;
+    AllocationExempt device;
+    if (m_reply.isEmpty()) {
+        return false;
+    }
+    memset(buffer, 0, m_reportSize);
+    memcpy(buffer, m_reply.constData(), qMin(m_reply.size(), m_reportSize));
+    m_reply.clear();
+    ++m_reportsIn;
+    return true;
+}
+
+void HidSimulator::processFrame()
+{
+    uint8_t payload[HidLink::MAX_REPORT_SIZE + 2];
+    int len = HidProtocol::unframe((const uint8_t *)m_rxFrame.constData(), m_rxFrame.size(),
+                                   payload, sizeof(payload));
+    if (len < 3) {
+        return;
+    }
+    uint16_t crc = payload[len - 2] + (payload[len - 1] << 8);
+    if (CRC::crc16(payload, len - 2) != crc) {
+        return;
+    }
+    processCommand(payload, len - 2);
+}
+
+void HidSimulator::processCommand(const uint8_t *data, int len)
+{
+    switch (data[0]) {
+    case HidProtocol::ReadBootInfo::code: {
+        uint8_t info[3] = {data[0], VERSION >> 8, VERSION & 0xff};
+        reply(info, sizeof(info));
+        return;
+    }
+    case HidProtocol::EraseFlash::code:
+        m_pages.clear();
+        break;
+    case HidProtocol::ProgramFlash::code:
+        //Binary hex records back to back, see HexRecord::build
+        for (int i = 1; i + 5 <= len; i += data[i] + 5) {
+            const uint8_t *record = &data[i];
+            if (record[3] == HexRecord::HEX_LIN_ADDRESS) {
+                m_linAddress = (record[4] << 24) | (record[5] << 16);
+            } else if (record[3] == HexRecord::HEX_DATA) {
+                program(m_linAddress | (record[1] << 8) | record[2], &record[4], record[0]);
+            }
+        }
+        break;
+    case HidProtocol::ReadCrc::code: {
+        if (len != HidProtocol::ReadCrc::requestLength) {
+            return;
+        }
+        uint32_t address;
+        uint32_t length;
+        memcpy(&address, &data[1], 4);
+        memcpy(&length, &data[5], 4);
+        uint16_t crc = crc16(address, length);
+        uint8_t result[3] = {data[0], (uint8_t)(crc & 0xff), (uint8_t)(crc >> 8)};
+        reply(result, sizeof(result));
+        return;
+    }
+    case HidProtocol::JumpToApp::code:
+        break;
+    default:
+        return;
+    }
+    reply(data, 1);
+}
+
+void HidSimulator::program(uint32_t address, const uint8_t *data, int len)
+{
+    address &= PHYSICAL_MASK;
+    while (len > 0) {
+        uint32_t offset = address % PAGE_SIZE;
+        int chunk = qMin(len, (int)(PAGE_SIZE - offset));
+        QByteArray &page = m_pages[address / PAGE_SIZE];
+        if (page.isEmpty()) {
+            page.fill((char)0xff, PAGE_SIZE);
+        }
+        memcpy(page.data() + offset, data, chunk);
+        address += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+uint16_t HidSimulator::crc16(uint32_t address, uint32_t len) const
+{
+    static const QByteArray blank(PAGE_SIZE, (char)0xff);
+    uint16_t crc = 0;
+    address &= PHYSICAL_MASK;
+    while (len > 0) {
+        uint32_t offset = address % PAGE_SIZE;
+        uint32_t chunk = qMin(len, (uint32_t)PAGE_SIZE - offset);
+        const QByteArray page = m_pages.value(address / PAGE_SIZE, blank);
+        crc = CRC::crc16((const uint8_t *)page.constData() + offset, chunk, crc);
+        address += chunk;
+        len -= chunk;
+    }
+    return crc;
+}
+
+void HidSimulator::reply(const uint8_t *data, int len)
+{
+    uint8_t framed[HidProtocol::maxFramedLength(HidLink::MAX_REPORT_SIZE)];
+    m_reply = QByteArray((const char *)framed, HidProtocol::frame(data, len, framed));
+}
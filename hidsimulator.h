@@ -0,0 +1,41 @@
+#ifndef HIDSIMULATOR_H
+#define HIDSIMULATOR_H
+
+#include <QByteArray>
+#include <QHash>
+#include "hidlink.h"
+
+//In-process stand-in for a Harmony HID bootloader target.  Frames are decoded
+//and answered the way the device does, and the reports in each direction are
+//counted so the USB timing can be modelled without hardware.
+class HidSimulator : public HidLink
+{
+public:
+    explicit HidSimulator(int reportSize = DEFAULT_REPORT_SIZE);
+    virtual bool WriteDevice(uint8_t *buffer, int len, int wait_ms = 200) override;
+    virtual bool ReadDevice(uint8_t *buffer, int wait_ms = 200) override;
+    virtual bool Connected(void) override {return true;}
+    virtual void Close(void) override {}
+    virtual int inputReportSize(void) override {return m_reportSize;}
+    virtual int outputReportSize(void) override {return m_reportSize;}
+    qint64 reportsOut() const {return m_reportsOut;}
+    qint64 reportsIn() const {return m_reportsIn;}
+private:
+    enum {VERSION = 0x0301, PAGE_SIZE = 4096};
+    static const uint32_t PHYSICAL_MASK = 0x1fffffff;
+    int m_reportSize;
+    QByteArray m_rxFrame;
+    bool m_escaped;
+    QByteArray m_reply;
+    uint32_t m_linAddress;
+    QHash<uint32_t, QByteArray> m_pages;    //sparse flash, unwritten bytes read as 0xff
+    qint64 m_reportsOut;
+    qint64 m_reportsIn;
+    void processFrame();
+    void processCommand(const uint8_t *data, int len);
+    void program(uint32_t address, const uint8_t *data, int len);
+    uint16_t crc16(uint32_t address, uint32_t len) const;
+    void reply(const uint8_t *data, int len);
+};
+
+#endif // HIDSIMULATOR_H
@@ -0,0 +1,120 @@
+#include "imagebuilder.h"
+#include "hexfile.h"
+#include "elffile.h"
+#include "srecfile.h"
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+
+ImageBuilder::ImageBuilder() : m_physicalAddresses(false)
+{
+
+}
+
+bool ImageBuilder::addFile(QString fileSpec, uint32_t defaultBinAddress)
+{
+    FirmwareImage image;
+    QString fileName = fileSpec;
+    uint32_t binAddress = defaultBinAddress;
+    int at = fileSpec.lastIndexOf('@');
+    if (at > 0 && !fileSpec.mid(at).contains('/') && !fileSpec.mid(at).contains('\\')) {
+        bool ok;
+        binAddress = fileSpec.mid(at + 1).toUInt(&ok, 16);
+        if (!ok) {
+            m_errors.append(QString("Invalid address in %1").arg(fileSpec));
+            return false;
+        }
+        fileName = fileSpec.left(at);
+    }
+    if (fileName.endsWith(".hex", Qt::CaseInsensitive)) {
+        if (!HexFile::loadHex(fileName, image)) {
+            m_errors.append(QString("Unable to read %1").arg(fileName));
+            return false;
+        }
+    } else if (fileName.endsWith(".elf", Qt::CaseInsensitive)) {
+        if (!ElfFile::loadElf(fileName, image, m_physicalAddresses)) {
+            m_errors.append(QString("Unable to read %1").arg(fileName));
+            return false;
+        }
+    } else if (fileName.endsWith(".srec", Qt::CaseInsensitive) || fileName.endsWith(".s19", Qt::CaseInsensitive)
+               || fileName.endsWith(".s28", Qt::CaseInsensitive) || fileName.endsWith(".s37", Qt::CaseInsensitive)
+               || fileName.endsWith(".mot", Qt::CaseInsensitive)) {
+        if (!SRecFile::loadSRec(fileName, image)) {
+            m_errors.append(QString("Unable to read %1").arg(fileName));
+            return false;
+        }
+    } else if (fileName.endsWith(".bin", Qt::CaseInsensitive)) {
+        if (binAddress == NO_ADDRESS) {
+            m_errors.append(QString("No load address for %1").arg(fileName));
+            return false;
+        }
+        QFile binFile(fileName);
+        if (!binFile.open(QIODevice::ReadOnly)) {
+            m_errors.append(QString("Unable to read %1").arg(fileName));
+            return false;
+        }
+        image.addData(binAddress, binFile.readAll());
+    } else {
+        m_errors.append(QString("Unsupported file type %1").arg(fileName));
+        return false;
+    }
+    m_images.append(image);
+    m_names.append(QFileInfo(fileName).fileName());
+    return true;
+}
+
+bool ImageBuilder::build(FirmwareImage &image)
+{
+    //Sort every segment of every input by address, then a single sweep
+    //finds all overlaps between files.
+    QList<ImageRange> ranges;
+    for (int i = 0; i < m_images.size(); ++i) {
+        const QMap<uint32_t, QByteArray> &segments = m_images[i].segments();
+        for (auto it = segments.cbegin(); it != segments.cend(); ++it) {
+            ImageRange range = {it.key(), it.key() + (uint32_t)it.value().size(), i};
+            ranges.append(range);
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const ImageRange &a, const ImageRange &b) {
+        return a.start < b.start;
+    });
+    int conflicts = 0;
+    int furthest = -1;  //range reaching furthest so far
+    for (int i = 0; i < ranges.size(); ++i) {
+        if (furthest >= 0 && ranges[i].start < ranges[furthest].end) {
+            const ImageRange &a = ranges[furthest];
+            const ImageRange &b = ranges[i];
+            m_errors.append(QString("%1 [0x%2-0x%3] overlaps %4 [0x%5-0x%6]")
+                            .arg(m_names[a.source])
+                            .arg(a.start, 8, 16, QChar('0')).arg(a.end - 1, 8, 16, QChar('0'))
+                            .arg(m_names[b.source])
+                            .arg(b.start, 8, 16, QChar('0')).arg(b.end - 1, 8, 16, QChar('0')));
+            ++conflicts;
+        }
+        if (furthest < 0 || ranges[i].end > ranges[furthest].end) {
+            furthest = i;
+        }
+    }
+    if (conflicts > 0 || m_images.isEmpty()) {
+        return false;
+    }
+    image.clear();
+    for (auto &i : m_images) {
+        const QMap<uint32_t, QByteArray> &segments = i.segments();
+        for (auto it = segments.cbegin(); it != segments.cend(); ++it) {
+            image.addData(it.key(), it.value());
+        }
+    }
+    return true;
+}
+
+QStringList ImageBuilder::splitFileList(QString fileNames)
+{
+    QStringList list;
+    for (auto &i : fileNames.split(';')) {
+        if (i.trimmed() != "") {
+            list.append(i.trimmed());
+        }
+    }
+    return list;
+}
@@ -0,0 +1,33 @@
+#ifndef IMAGEBUILDER_H
+#define IMAGEBUILDER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include "firmwareimage.h"
+
+//Combines several hex/bin/elf/srec files into one image.  Bin files are given
+//as name.bin@address, or use the default address passed to addFile.
+class ImageBuilder
+{
+public:
+    ImageBuilder();
+    bool addFile(QString fileSpec, uint32_t defaultBinAddress = NO_ADDRESS);
+    bool build(FirmwareImage &image);
+    void setPhysicalAddresses(bool physical) {m_physicalAddresses = physical;}
+    QStringList errors() const {return m_errors;}
+    static QStringList splitFileList(QString fileNames);
+    static const uint32_t NO_ADDRESS = 0xffffffff;
+private:
+    typedef struct {
+        uint32_t start;
+        uint32_t end;
+        int source;
+    } ImageRange;
+    QList<FirmwareImage> m_images;
+    QStringList m_names;
+    QStringList m_errors;
+    bool m_physicalAddresses;
+};
+
+#endif // IMAGEBUILDER_H
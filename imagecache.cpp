@@ -0,0 +1,193 @@
+#include "imagecache.h"
+#include "imagestream.h"
+#include "imagebuilder.h"
+#include "crc.h"
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QtConcurrent/QtConcurrent>
+
+ImageCache &ImageCache::instance()
+{
+    static ImageCache cache;
+    return cache;
+}
+
+ImageCache::ImageCache()
+{
+    m_cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/images";
+    QDir().mkpath(m_cacheDir);
+}
+
+std::shared_ptr<const CachedImage> ImageCache::get(QString fileNames, bool physicalAddresses,
+                                                   uint32_t eraseBlockSize, QStringList *errors)
+{
+    //One lookup at a time so a background preload and a Program press on the
+    //same file share a single parse.
+    QMutexLocker lock(&m_mutex);
+    if (ImageStream::isStream(fileNames)) {
+        //Reading it here would consume it
+        if (errors) {
+            errors->append("Streamed images are programmed as they arrive, over USB HID only");
+        }
+        return nullptr;
+    }
+    QByteArray key = contentKey(fileNames, physicalAddresses);
+    if (key.isEmpty()) {
+        if (errors) {
+            errors->append("Unable to read firmware file");
+        }
+        return nullptr;
+    }
+    std::shared_ptr<const CachedImage> cached = m_entries.value(key);
+    if (cached && (eraseBlockSize == 0 || cached->paddedCRC32.contains(eraseBlockSize))) {
+        m_order.removeOne(key);
+        m_order.append(key);
+        return cached;
+    }
+    std::shared_ptr<CachedImage> entry(new CachedImage());
+    bool changed = false;
+    if (cached) {
+        *entry = *cached;
+    } else if (!readDisk(key, *entry)) {
+        ImageBuilder builder;
+        builder.setPhysicalAddresses(physicalAddresses);
+        bool ok = true;
+        for (auto &i : ImageBuilder::splitFileList(fileNames)) {
+            ok = builder.addFile(i) && ok;
+        }
+        if (!ok || !builder.build(entry->image)) {
+            if (errors) {
+                errors->append(builder.errors());
+            }
+            return nullptr;
+        }
+        const QMap<uint32_t, QByteArray> &segments = entry->image.segments();
+        for (auto &i : segments) {
+            entry->regionCRCs.append(CRC::crc16((const uint8_t *)i.constData(), i.size()));
+        }
+        changed = true;
+    }
+    if (eraseBlockSize > 0 && !entry->paddedCRC32.contains(eraseBlockSize)) {
+        QByteArray flat = entry->image.flatten(entry->image.startAddress(), eraseBlockSize);
+        entry->paddedCRC32.insert(eraseBlockSize, CRC::crc32((const uint8_t *)flat.constData(), flat.size()));
+        changed = true;
+    }
+    if (changed) {
+        writeDisk(key, *entry);
+    }
+    insert(key, entry);
+    return entry;
+}
+
+void ImageCache::preload(QString fileNames, bool physicalAddresses, uint32_t eraseBlockSize)
+{
+    //Fire and forget, the result is picked up by the next get()
+    (void) QtConcurrent::run([this, fileNames, physicalAddresses, eraseBlockSize]() {
+        get(fileNames, physicalAddresses, eraseBlockSize);
+    });
+}
+
+QByteArray ImageCache::contentKey(QString fileNames, bool physicalAddresses)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QStringList files = ImageBuilder::splitFileList(fileNames);
+    if (files.isEmpty()) {
+        return QByteArray();
+    }
+    hash.addData(physicalAddresses ? "P" : "V", 1);
+    for (auto &i : files) {
+        //The spec (type and load address) is part of the key as well as the content
+        QString name = i.section('@', 0, 0);
+        QFile file(name);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+        QByteArray spec = (QFileInfo(name).suffix().toLower() + i.mid(name.size())).toUtf8();
+        hash.addData(spec);
+        hash.addData(&file);
+    }
+    return hash.result().toHex();
+}
+
+bool ImageCache::readDisk(const QByteArray &key, CachedImage &entry)
+{
+    QFile file(m_cacheDir + "/" + key + ".img");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    quint32 version;
+    quint32 segmentCount;
+    in >> version;
+    if (version != FORMAT_VERSION) {
+        return false;
+    }
+    in >> segmentCount;
+    entry.image.clear();
+    for (quint32 i = 0; i < segmentCount && in.status() == QDataStream::Ok; ++i) {
+        quint32 address;
+        QByteArray data;
+        in >> address >> data;
+        entry.image.addData(address, data);
+    }
+    QVector<quint16> crcs;
+    QMap<quint32, quint32> padded;
+    in >> crcs >> padded;
+    if (in.status() != QDataStream::Ok || crcs.size() != entry.image.segments().size()) {
+        entry.image.clear();
+        return false;
+    }
+    //The modification time orders the files for pruneDisk
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    entry.regionCRCs = crcs;
+    entry.paddedCRC32 = padded;
+    return true;
+}
+
+void ImageCache::writeDisk(const QByteArray &key, const CachedImage &entry)
+{
+    QSaveFile file(m_cacheDir + "/" + key + ".img");
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out(&file);
+    const QMap<uint32_t, QByteArray> &segments = entry.image.segments();
+    out << (quint32)FORMAT_VERSION << (quint32)segments.size();
+    for (auto it = segments.cbegin(); it != segments.cend(); ++it) {
+        out << (quint32)it.key() << it.value();
+    }
+    out << entry.regionCRCs << entry.paddedCRC32;
+    if (file.commit()) {
+        pruneDisk();
+    }
+}
+
+void ImageCache::pruneDisk()
+{
+    //A CI host that stamps a serial into every image writes a new entry
+    //per board, keep the most recently used ones within count and size
+    QFileInfoList files = QDir(m_cacheDir).entryInfoList(QStringList("*.img"), QDir::Files, QDir::Time);
+    qint64 bytes = 0;
+    for (int i = 0; i < files.size(); ++i) {
+        bytes += files[i].size();
+        if (i >= MAX_DISK_ENTRIES || bytes > MAX_DISK_BYTES) {
+            QFile::remove(files[i].filePath());
+        }
+    }
+}
+
+void ImageCache::insert(const QByteArray &key, std::shared_ptr<const CachedImage> entry)
+{
+    if (!m_entries.contains(key) && m_entries.size() >= MAX_ENTRIES) {
+        m_entries.remove(m_order.takeFirst());
+    }
+    m_order.removeOne(key);
+    m_order.append(key);
+    m_entries.insert(key, entry);
+}
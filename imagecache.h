@@ -0,0 +1,44 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+#include <QStringList>
+#include <memory>
+#include "firmwareimage.h"
+
+typedef struct {
+    FirmwareImage image;
+    QVector<uint16_t> regionCRCs;       //CRC-16 of each image segment, for HID verify
+    QMap<uint32_t, uint32_t> paddedCRC32;   //UART CRC-32 keyed by erase block size
+} CachedImage;
+
+//Parsed images keyed by a SHA-256 of the input file contents.  Entries live
+//in memory for the session and on disk across runs, so flashing the same
+//build again skips parsing entirely.  Both tiers drop the least recently
+//used entries first.
+class ImageCache
+{
+public:
+    static ImageCache &instance();
+    std::shared_ptr<const CachedImage> get(QString fileNames, bool physicalAddresses,
+                                           uint32_t eraseBlockSize = 0, QStringList *errors = nullptr);
+    void preload(QString fileNames, bool physicalAddresses, uint32_t eraseBlockSize = 0);
+private:
+    ImageCache();
+    enum {MAX_ENTRIES = 8, MAX_DISK_ENTRIES = 64, MAX_DISK_BYTES = 256 * 1024 * 1024, FORMAT_VERSION = 1};
+    QMutex m_mutex;
+    QHash<QByteArray, std::shared_ptr<const CachedImage>> m_entries;
+    QList<QByteArray> m_order;      //keys of m_entries, least recently used first
+    QString m_cacheDir;
+    QByteArray contentKey(QString fileNames, bool physicalAddresses);
+    bool readDisk(const QByteArray &key, CachedImage &entry);
+    void writeDisk(const QByteArray &key, const CachedImage &entry);
+    void pruneDisk();
+    void insert(const QByteArray &key, std::shared_ptr<const CachedImage> entry);
+};
+
+#endif // IMAGECACHE_H
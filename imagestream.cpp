@@ -0,0 +1,178 @@
+#include "imagestream.h"
+#include "hexfile.h"
+#include <cstdio>
+#include <string.h>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+static bool isNamedPipe(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    struct stat info;
+    return stat(QFile::encodeName(path).constData(), &info) == 0 && S_ISFIFO(info.st_mode);
+#else
+    return path.startsWith("\\\\.\\pipe\\", Qt::CaseInsensitive);
+#endif
+}
+
+ImageStream::ImageStream() : m_start(0), m_end(0), m_eof(false), m_linAddress(0), m_segAddress(0),
+    m_received(0), m_expected(0), m_lineNumber(0)
+{
+
+}
+
+QString ImageStream::streamPath(QString fileName, qint64 *expected)
+{
+    //"-" for stdin, the pipe path otherwise, null if fileName is not a stream
+    fileName = fileName.trimmed();
+    QString query;
+    int at = fileName.indexOf('?');
+    if (at >= 0) {
+        query = fileName.mid(at + 1);
+        fileName = fileName.left(at);
+    }
+    QString path;
+    if (fileName == "-" || fileName == "stdin://") {
+        path = "-";
+    } else if (fileName.startsWith("fifo://")) {
+        path = fileName.mid(7);
+    } else if (isNamedPipe(fileName)) {
+        path = fileName;
+    } else {
+        return QString();
+    }
+    if (expected) {
+        *expected = 0;
+        for (auto &i : query.split('&')) {
+            if (i.startsWith("size=")) {
+                *expected = i.mid(5).toLongLong();
+            }
+        }
+    }
+    return path;
+}
+
+bool ImageStream::isStream(QString fileName)
+{
+    return !streamPath(fileName).isNull();
+}
+
+bool ImageStream::open(QString fileName)
+{
+    close();
+    m_start = 0;
+    m_end = 0;
+    m_eof = false;
+    m_linAddress = 0;
+    m_segAddress = 0;
+    m_received = 0;
+    m_lineNumber = 0;
+    m_error.clear();
+    QString path = streamPath(fileName, &m_expected);
+    if (path.isNull()) {
+        m_error = fileName + " is not a stream";
+        return false;
+    }
+    //Unbuffered so records are handed out as soon as a read returns
+    bool ok;
+    if (path == "-") {
+        ok = m_file.open(fileno(stdin), QIODevice::ReadOnly | QIODevice::Unbuffered);
+    } else {
+        m_file.setFileName(path);
+        ok = m_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+    if (!ok) {
+        m_error = QString("Unable to open %1: %2").arg(path == "-" ? "standard input" : path, m_file.errorString());
+    }
+    return ok;
+}
+
+void ImageStream::close()
+{
+    //Standard input is left open, QFile does not own the descriptor
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+int ImageStream::next(uint32_t &address, const uint8_t *&data, uint8_t &len)
+{
+    while (readLine()) {
+        HexRecord rec(m_line);
+        if (!rec.isValid()) {
+            //Same as HexFile::loadHex, anything that is not a record is skipped
+            continue;
+        }
+        //A file can be read again if it turns out to be bad, a stream cannot
+        uint8_t checksum = 0;
+        for (int i = 0; i < rec.recLength(); ++i) {
+            checksum += rec.toBinary()[i];
+        }
+        if (checksum != 0) {
+            m_error = QString("Checksum error on line %1 of the stream").arg(m_lineNumber);
+            return FAILED;
+        }
+        switch (rec.recType()) {
+        case HexRecord::HEX_LIN_ADDRESS:
+            m_linAddress = rec.address();
+            break;
+        case HexRecord::HEX_SEG_ADDRESS:
+            m_segAddress = rec.address();
+            break;
+        case HexRecord::HEX_DATA:
+            address = rec.address() + m_segAddress + m_linAddress;
+            len = rec.dataLength();
+            memcpy(m_data, rec.data(), len);
+            data = m_data;
+            return DATA;
+        case HexRecord::HEX_EOF:
+            return END;
+        }
+    }
+    if (m_error.isEmpty()) {
+        m_error = "Stream ended without an end of file record";
+    }
+    return FAILED;
+}
+
+bool ImageStream::readLine()
+{
+    //Leaves the next line in m_line, newline terminated for HexRecord
+    for (;;) {
+        char *newline = (char *)memchr(m_buffer + m_start, '\n', m_end - m_start);
+        int len = newline ? newline - (m_buffer + m_start) : m_end - m_start;
+        if (len > MAX_LINE) {
+            m_error = QString("Line %1 of the stream is too long for a hex record").arg(m_lineNumber + 1);
+            return false;
+        }
+        if (newline || (m_eof && len > 0)) {
+            memcpy(m_line, m_buffer + m_start, len);
+            m_start += newline ? len + 1 : len;
+            if (len > 0 && m_line[len - 1] == '\r') {
+                --len;
+            }
+            m_line[len] = '\n';
+            m_line[len + 1] = 0;
+            ++m_lineNumber;
+            return true;
+        }
+        if (m_eof) {
+            return false;
+        }
+        //Keep the partial line and fill in behind it
+        if (m_start > 0) {
+            memmove(m_buffer, m_buffer + m_start, len);
+            m_start = 0;
+            m_end = len;
+        }
+        qint64 n = m_file.read(m_buffer + m_end, qMin((int)READ_CHUNK, BUFFER_SIZE - m_end));
+        if (n < 0) {
+            m_error = m_file.errorString();
+            return false;
+        }
+        m_eof = n == 0;
+        m_end += n;
+        m_received += n;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include <QFile>
+#include <QString>
+#include <stdint.h>
+
+//Intel hex arriving on stdin or through a named pipe, for images that are
+//generated (signed, serial stamped) as they are flashed.  Records are parsed
+//out of a fixed read buffer as they arrive and nothing else is kept, so the
+//memory used is the same whatever the size of the image.
+//
+//Streams are given as "-" or "stdin://" for standard input, "fifo://path"
+//or just the path of a named pipe.  "?size=bytes" after any of them gives
+//the expected length of the hex text, for progress.
+class ImageStream
+{
+public:
+    ImageStream();
+    static bool isStream(QString fileName);
+    bool open(QString fileName);
+    void close();
+    enum {DATA, END, FAILED};
+    //Waits for the next data record.  Returns DATA with an absolute address
+    //and data valid until the next call, END after the end of file record,
+    //or FAILED (see errorString()), including a stream that stops without
+    //an end of file record.
+    int next(uint32_t &address, const uint8_t *&data, uint8_t &len);
+    qint64 bytesReceived() const {return m_received;}
+    qint64 expectedSize() const {return m_expected;}
+    QString errorString() const {return m_error;}
+private:
+    enum {BUFFER_SIZE = 65536, READ_CHUNK = 4096, MAX_LINE = 265};
+    QFile m_file;
+    char m_buffer[BUFFER_SIZE];
+    int m_start;
+    int m_end;
+    bool m_eof;
+    char m_line[MAX_LINE + 2];
+    uint8_t m_data[256];
+    uint32_t m_linAddress;
+    uint32_t m_segAddress;
+    qint64 m_received;
+    qint64 m_expected;
+    int m_lineNumber;
+    QString m_error;
+    bool readLine();
+    static QString streamPath(QString fileName, qint64 *expected = nullptr);
+};
+
+#endif // IMAGESTREAM_H
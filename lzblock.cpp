@@ -0,0 +1,96 @@
+#include "lzblock.h"
+#include "target/lz_decode.h"
+#include <string.h>
+
+//Greedy LZ4 block compressor.  The hash table is small so a page can be
+//compressed in a few microseconds and the output is decoded on the target
+//by target/lz_decode.c using only the page buffer as its window.
+int LZBlock::compress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity)
+{
+    uint16_t table[1 << HASH_BITS];
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *srcEnd = src + srcLen;
+    const uint8_t *matchLimit = srcEnd - MATCH_LIMIT;
+    uint8_t *op = dst;
+    uint8_t *dstEnd = dst + dstCapacity;
+
+    if (srcLen > MAX_OFFSET + 1) {
+        return 0;  //positions are stored in 16 bits
+    }
+    memset(table, 0, sizeof(table));
+    if (srcLen > MATCH_LIMIT) {
+        ++ip;
+        while (ip < matchLimit) {
+            uint32_t h = hash(ip);
+            const uint8_t *ref = src + table[h];
+            table[h] = (uint16_t)(ip - src);
+            if (ref >= ip || memcmp(ref, ip, MIN_MATCH) != 0) {
+                ++ip;
+                continue;
+            }
+            const uint8_t *matchEnd = ip + MIN_MATCH;
+            const uint8_t *refEnd = ref + MIN_MATCH;
+            while (matchEnd < srcEnd - LAST_LITERALS && *matchEnd == *refEnd) {
+                ++matchEnd;
+                ++refEnd;
+            }
+            uint32_t literals = ip - anchor;
+            uint32_t matchLen = (matchEnd - ip) - MIN_MATCH;
+            //token + literal length bytes + literals + offset + match length bytes
+            if (op + 1 + literals / 255 + 1 + literals + 2 + matchLen / 255 + 1 > dstEnd) {
+                return 0;
+            }
+            uint8_t *token = op++;
+            *token = (literals >= 15 ? 15 : literals) << 4;
+            if (literals >= 15) {
+                op = writeLength(op, literals - 15);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+            uint32_t offset = ip - ref;
+            *op++ = offset & 0xff;
+            *op++ = (offset >> 8) & 0xff;
+            *token |= matchLen >= 15 ? 15 : matchLen;
+            if (matchLen >= 15) {
+                op = writeLength(op, matchLen - 15);
+            }
+            ip = matchEnd;
+            anchor = ip;
+        }
+    }
+    uint32_t literals = srcEnd - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > dstEnd) {
+        return 0;
+    }
+    uint8_t *token = op++;
+    *token = (literals >= 15 ? 15 : literals) << 4;
+    if (literals >= 15) {
+        op = writeLength(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+    return op - dst;
+}
+
+int LZBlock::decompress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity)
+{
+    return lz_decode(src, srcLen, dst, dstCapacity);
+}
+
+uint32_t LZBlock::hash(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+uint8_t *LZBlock::writeLength(uint8_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
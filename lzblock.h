@@ -0,0 +1,19 @@
+#ifndef LZBLOCK_H
+#define LZBLOCK_H
+
+#include <stdint.h>
+
+class LZBlock
+{
+public:
+    //Returns compressed length or 0 if the result does not fit in dstCapacity
+    static int compress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity);
+    //Returns decompressed length or -1 if the block is invalid
+    static int decompress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity);
+private:
+    enum {HASH_BITS = 12, MIN_MATCH = 4, LAST_LITERALS = 5, MATCH_LIMIT = 12, MAX_OFFSET = 65535};
+    static uint32_t hash(const uint8_t *p);
+    static uint8_t *writeLength(uint8_t *op, uint32_t len);
+};
+
+#endif // LZBLOCK_H
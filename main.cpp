@@ -1,13 +1,120 @@
 #include "mainwindow.h"
+#include "simulatorserver.h"
+#include "throughputbenchmark.h"
+#ifdef Q_OS_LINUX
+#include "cansimulator.h"
+#include "canbootloader.h"
+#endif
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QFile>
+#include <QSettings>
+#include <QTextStream>
 
 int main(int argc, char *argv[])
 {
     QApplication::setOrganizationName("QES");
     QApplication::setApplicationName("HarmonyBootloader");
     QApplication a(argc, argv);
-    MainWindow w;
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption serverOption("simulator-server",
+            "Serve the simulated UART target on a TCP port instead of opening the window.", "port");
+    QCommandLineOption blockOption("erase-block-size", "Erase block size of the simulated target.",
+                                   "bytes", "8192");
+    QCommandLineOption latencyOption("latency", "Delay every reply of the simulated target.", "ms", "0");
+    QCommandLineOption listenOption("listen", "Address the simulated target listens on.", "address", "127.0.0.1");
+    QCommandLineOption simulatorOption("simulator",
+            "List the simulated UART target with the serial ports (always listed in debug builds).");
+    parser.addOption(serverOption);
+    parser.addOption(listenOption);
+    parser.addOption(simulatorOption);
+    parser.addOption(blockOption);
+    parser.addOption(latencyOption);
+    QCommandLineOption benchmarkOption("benchmark",
+            "Run the throughput benchmark against the simulated targets instead of opening the window.");
+    QCommandLineOption baselineOption("baseline", "Benchmark results to compare with, exits 1 on a regression.",
+                                      "file");
+    QCommandLineOption saveBaselineOption("save-baseline", "Save the benchmark results as a baseline.", "file");
+    QCommandLineOption thresholdOption("threshold", "Allowed benchmark regression.", "percent", "10");
+    parser.addOption(benchmarkOption);
+    parser.addOption(baselineOption);
+    parser.addOption(saveBaselineOption);
+    parser.addOption(thresholdOption);
+#ifdef Q_OS_LINUX
+    QCommandLineOption canOption("can-simulator",
+            "Run a simulated CAN bootloader node on an interface (e.g. vcan0) instead of opening the window.",
+            "interface");
+    QCommandLineOption canFdOption("can-fd", "Simulated CAN node uses CAN-FD frames.");
+    parser.addOption(canOption);
+    parser.addOption(canFdOption);
+#endif
+    parser.process(a);
+#ifdef Q_OS_LINUX
+    if (parser.isSet(canOption)) {
+        CANSimulator node(parser.value(canOption), parser.isSet(canFdOption), CANBootloader::DEFAULT_BASE_ID);
+        if (!node.isOpen()) {
+            qCritical("%s", qPrintable(node.errorString()));
+            return 1;
+        }
+        node.start();
+        int ret = a.exec();
+        node.stop();
+        node.wait();
+        return ret;
+    }
+#endif
+    if (parser.isSet(benchmarkOption)) {
+        QTextStream out(stdout);
+        ThroughputBenchmark benchmark;
+        QList<BenchmarkResult> results = benchmark.run();
+        out << ThroughputBenchmark::table(results) << "\n";
+        out << ThroughputBenchmark::wakeupReport(QSettings().value("realtime_core", -1).toInt()) << "\n";
+        if (parser.isSet(saveBaselineOption)) {
+            QFile file(parser.value(saveBaselineOption));
+            if (!file.open(QIODevice::WriteOnly)
+                    || file.write(QJsonDocument(ThroughputBenchmark::toJson(results)).toJson()) < 0) {
+                qCritical("Unable to write %s", qPrintable(file.fileName()));
+                return 1;
+            }
+        }
+        QJsonObject baseline;
+        if (parser.isSet(baselineOption)) {
+            QFile file(parser.value(baselineOption));
+            if (!file.open(QIODevice::ReadOnly)) {
+                qCritical("Unable to read %s", qPrintable(file.fileName()));
+                return 1;
+            }
+            baseline = QJsonDocument::fromJson(file.readAll()).object();
+        }
+        QStringList regressions = ThroughputBenchmark::regressions(results, baseline,
+                                                                   parser.value(thresholdOption).toDouble() / 100);
+        for (auto &i : regressions) {
+            out << "REGRESSION " << i << "\n";
+        }
+        return regressions.isEmpty() ? 0 : 1;
+    }
+    if (parser.isSet(serverOption)) {
+        //Loopback unless asked, the simulated target takes any connection
+        QHostAddress address(parser.value(listenOption));
+        if (address.isNull()) {
+            qCritical("Invalid listen address %s", qPrintable(parser.value(listenOption)));
+            return 1;
+        }
+        SimulatorServer server(parser.value(blockOption).toUShort(), parser.value(latencyOption).toInt());
+        if (!server.listen(address, parser.value(serverOption).toUShort())) {
+            qCritical("Unable to listen: %s", qPrintable(server.errorString()));
+            return 1;
+        }
+        return a.exec();
+    }
+#ifdef QT_DEBUG
+    MainWindow w(nullptr, true);
+#else
+    MainWindow w(nullptr, parser.isSet(simulatorOption));
+#endif
     w.show();
     return a.exec();
 }
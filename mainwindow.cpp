@@ -4,35 +4,81 @@
 #include <QFileDialog>
 #include <QCloseEvent>
 #include <QMessageBox>
-#include <QJsonDocument>
 #include <QJsonObject>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QDir>
+#include <QInputDialog>
+#include <QThread>
 #include "hidbootloader.h"
 #include "uartbootloader.h"
+#include "uartsimulator.h"
 #include "workerthread.h"
-#include <QtSerialPort/QSerialPortInfo>
 #include "aboutdialog.h"
+#include "imagebuilder.h"
+#include "tracereplay.h"
+#include "imagecache.h"
+#include "flashplan.h"
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(QWidget *parent, bool simulatorPort)
     : QMainWindow(parent)
-    , ui(new Ui::MainWindow), bootloader(nullptr), worker(nullptr)
+    , ui(new Ui::MainWindow), bootloader(nullptr), worker(nullptr), simulatorPort(simulatorPort), triggerDone(false)
 {
     QSettings settings;
     ui->setupUi(this);
+    //Parse the selected file in the background once typing settles
+    preloadTimer.setSingleShot(true);
+    preloadTimer.setInterval(300);
+    connect(&preloadTimer, &QTimer::timeout, this, &MainWindow::preloadImage);
+    //Device lists and connects come back from DeviceService when ready
+    connect(&deviceService, &DeviceService::familiesLoaded, this, &MainWindow::onFamiliesLoaded);
+    connect(&deviceService, &DeviceService::portsChanged, this, &MainWindow::onPortsChanged);
+    connect(&deviceService, &DeviceService::hidConnected, this, &MainWindow::onHidConnected);
+    connect(&deviceService, &DeviceService::canConnected, this, &MainWindow::onCanConnected);
+    connect(&deviceService, &DeviceService::bootloaderTriggered, this, &MainWindow::onBootloaderTriggered);
+    //Filled in with the profiles from devices.json in onFamiliesLoaded
+    triggerGroup = new QActionGroup(this);
+    ui->actionManual_entry->setData(-1);
+    triggerGroup->addAction(ui->actionManual_entry);
     ui->vidEdit->setText(settings.value("last_vid", "0x04d8").toString());
     ui->pidEdit->setText(settings.value("last_pid", "0x003c").toString());
-    ui->baudComboBox->setCurrentIndex(settings.value("last_baud", 0).toInt());
+    //Any rate can be typed in, older settings only stored the list index
+    if (settings.contains("last_baud_rate")) {
+        ui->baudComboBox->setCurrentText(settings.value("last_baud_rate").toString());
+    } else {
+        ui->baudComboBox->setCurrentIndex(settings.value("last_baud", 0).toInt());
+    }
+#ifdef Q_OS_LINUX
+    ui->connectionTypeComboBox->addItem("CAN");
+#endif
     ui->connectionTypeComboBox->setCurrentIndex(settings.value("last_connection_type", 0).toInt());
-    readDevices();
-    ui->familyComboBox->setCurrentIndex(
-                settings.value("last_family_index", 0).toInt());
+    deviceService.loadFamilies();
     ui->eraseSizeEdit->setText(
                 settings.value("last_erase_block_size", "8192").toString());
     ui->appStartEdit->setText(
                 settings.value("last_start_address", "0x402000").toString());
-    std::unique_ptr<QFile> test(new QFile(settings.value("last_file", "").toString()));
-    if (test->exists()) {
+    QStringList lastFiles = ImageBuilder::splitFileList(settings.value("last_file", "").toString());
+    bool filesExist = !lastFiles.isEmpty();
+    for (auto &i : lastFiles) {
+        std::unique_ptr<QFile> test(new QFile(i.section('@', 0, 0)));
+        filesExist = filesExist && test->exists();
+    }
+    if (filesExist) {
         ui->fileNameEdit->setText(settings.value("last_file", "").toString());
     }
+    ui->actionRecord_trace->setChecked(settings.value("record_trace", false).toBool());
+    ui->actionVerify_first->setChecked(settings.value("verify_first", false).toBool());
+    ui->actionBlank_check->setChecked(settings.value("blank_check", false).toBool());
+    ui->actionRealtime->setChecked(settings.value("realtime", false).toBool());
+    realtimeCore = settings.value("realtime_core", -1).toInt();
+    partFlashKb = settings.value("part_flash_kb", 0).toInt();
+#ifdef Q_OS_LINUX
+    ui->actionNative_serial->setChecked(settings.value("native_serial", true).toBool());
+    ui->actionCAN_FD->setChecked(settings.value("can_fd", false).toBool());
+#else
+    ui->actionNative_serial->setVisible(false);
+    ui->actionCAN_FD->setVisible(false);
+#endif
     ui->statusbar->clearMessage();
     connectLabel = new QLabel("Not connected");
     ui->statusbar->addWidget(connectLabel);
@@ -53,18 +99,40 @@ void MainWindow::on_connectionTypeComboBox_currentTextChanged(const QString &arg
         ui->baudComboBox->setEnabled(false);
         ui->appStartEdit->setEnabled(false);
         ui->eraseSizeEdit->setEnabled(false);
-    } else if (arg1 == "UART") {
+        deviceService.watchPorts(false);
+    } else if (arg1 == "UART" || arg1 == "CAN") {
+        DeviceService::PortKind kind = arg1 == "CAN" ? DeviceService::CAN_INTERFACES
+                                                     : DeviceService::SERIAL_PORTS;
         ui->pidEdit->setEnabled(false);
         ui->vidEdit->setEnabled(false);
         ui->portComboBox->setEnabled(true);
-        ui->baudComboBox->setEnabled(true);
+        ui->baudComboBox->setEnabled(arg1 == "UART");
         ui->appStartEdit->setEnabled(true);
         ui->eraseSizeEdit->setEnabled(true);
-        QList<QSerialPortInfo> portList = QSerialPortInfo::availablePorts();
-        ui->portComboBox->clear();
-        for (auto&& i : portList) {
-            ui->portComboBox->addItem(i.portName());
+        if (kind != deviceService.portKind()) {
+            ui->portComboBox->clear();
+            deviceService.setPortKind(kind);
         }
+        //Show the last known ports now, the scan updates them if they changed
+        onPortsChanged();
+        deviceService.watchPorts(true);
+    }
+}
+
+void MainWindow::onPortsChanged()
+{
+    QString current = ui->portComboBox->currentText();
+    ui->portComboBox->clear();
+    ui->portComboBox->addItems(deviceService.ports());
+    if (simulatorPort && deviceService.portKind() == DeviceService::SERIAL_PORTS) {
+        ui->portComboBox->addItem(UARTSimulator::portName());
+    }
+    int index = ui->portComboBox->findText(current);
+    if (index >= 0) {
+        ui->portComboBox->setCurrentIndex(index);
+    } else if (!current.isEmpty()) {
+        //Typed in, e.g. a tcp:// bridge
+        ui->portComboBox->setEditText(current);
     }
 }
 
@@ -73,12 +141,14 @@ void MainWindow::on_browseButton_clicked()
 {
     QString filter;
     if (ui->connectionTypeComboBox->currentText() == "USB") {
-        filter = "hex files (*.hex)";
-    } else if (ui->connectionTypeComboBox->currentText() == "UART"){
-        filter = "hex or bin files (*.hex *.bin)";
+        filter = "firmware files (*.hex *.elf *.srec *.s19 *.s28 *.s37 *.mot)";
+    } else {
+        filter = "firmware files (*.hex *.bin *.elf *.srec *.s19 *.s28 *.s37 *.mot)";
     }
-    QFileInfo fileInfo(ui->fileNameEdit->text());
-    fileName = QFileDialog::getOpenFileName(this, "Open firmware file", fileInfo.absolutePath(), filter);
+    QFileInfo fileInfo(ImageBuilder::splitFileList(ui->fileNameEdit->text()).value(0));
+    //Selecting several files merges them into one image
+    fileName = QFileDialog::getOpenFileNames(this, "Open firmware file", fileInfo.absolutePath(), filter)
+            .join(";");
     if (fileName != "") {
         ui->fileNameEdit->setText(fileName);
     }
@@ -105,11 +175,25 @@ void MainWindow::closeEvent(QCloseEvent *event)
     settings.setValue("last_vid", ui->vidEdit->text());
     settings.setValue("last_pid", ui->pidEdit->text());
     settings.setValue("last_file", ui->fileNameEdit->text());
-    settings.setValue("last_baud", ui->baudComboBox->currentIndex());
+    settings.setValue("last_baud_rate", ui->baudComboBox->currentText());
     settings.setValue("last_connection_type", ui->connectionTypeComboBox->currentIndex());
     settings.setValue("last_erase_block_size", ui->eraseSizeEdit->text());
     settings.setValue("last_start_address", ui->appStartEdit->text());
-    settings.setValue("last_family_index", ui->familyComboBox->currentIndex());
+    if (ui->familyComboBox->count() > 0) {
+        settings.setValue("last_family_index", ui->familyComboBox->currentIndex());
+    }
+    settings.setValue("record_trace", ui->actionRecord_trace->isChecked());
+    settings.setValue("verify_first", ui->actionVerify_first->isChecked());
+    settings.setValue("blank_check", ui->actionBlank_check->isChecked());
+    settings.setValue("native_serial", ui->actionNative_serial->isChecked());
+    settings.setValue("can_fd", ui->actionCAN_FD->isChecked());
+    settings.setValue("realtime", ui->actionRealtime->isChecked());
+    settings.setValue("realtime_core", realtimeCore);
+    settings.setValue("part_flash_kb", partFlashKb);
+    if (triggerGroup->checkedAction()) {
+        settings.setValue("trigger_profile", triggerGroup->checkedAction()->data().toInt() < 0 ?
+                              QString() : triggerGroup->checkedAction()->text());
+    }
     event->accept();
 }
 
@@ -129,20 +213,25 @@ void MainWindow::on_connectButton_clicked()
             QMessageBox::critical(this, QApplication::applicationName(), "Invalid pid - Enter in hex");
             return;
         }
-        bootloader.reset(new HidBootloader(vid, pid));
-        if (bootloader->isConnected()) {
-            int version = bootloader->readBootInfo();
-            connectLabel->setText(QString("Connected: VID = %1 PID = %2 Bootloader Version = %3.%4")
-                                  .arg(ui->vidEdit->text(), ui->pidEdit->text())
-                                  .arg(version >> 8).arg(version & 0xff));
-        } else {
-            QMessageBox::critical(this, QApplication::applicationName()
-                                  , QString("Unable to open device with vid=%1, pid=%2")
-                                    .arg(ui->vidEdit->text(), ui->pidEdit->text()));
+        if (startTrigger(QJsonObject{{"connection", "USB"}, {"vid", ui->vidEdit->text()},
+                                     {"pid", ui->pidEdit->text()}})) {
+            return;
         }
+        //Opening scans every HID device and the boot info read can time out,
+        //so it runs in the background and finishes in onHidConnected
+        bootloader = nullptr;
+        ui->connectButton->setEnabled(false);
+        ui->programButton->setEnabled(false);
+        connectLabel->setText("Connecting...");
+        deviceService.connectHid(vid, pid);
+        return;
     } else if (ui->connectionTypeComboBox->currentText() == "UART") {
-        int baud = ui->baudComboBox->currentText().toInt();
         bool ok;
+        int baud = ui->baudComboBox->currentText().toInt(&ok);
+        if (!ok || baud <= 0) {
+            QMessageBox::critical(this, QApplication::applicationName(), "Invalid baud rate");
+            return;
+        }
         uint32_t startAddress = ui->appStartEdit->text().toUInt(&ok, 16);
         if (!ok && ui->fileNameEdit->text().endsWith(".bin", Qt::CaseInsensitive)) {
             QMessageBox::critical(this, QApplication::applicationName(), "Invalid start address - Enter in hex");
@@ -153,7 +242,13 @@ void MainWindow::on_connectButton_clicked()
             QMessageBox::critical(this, QApplication::applicationName(), "Invalid erase block size - Enter in decimal");
             return;
         }
-        bootloader.reset(new UARTBootloader(ui->portComboBox->currentText(), baud, startAddress, eraseBlockSize));
+        if (startTrigger(QJsonObject{{"connection", "UART"}, {"port", ui->portComboBox->currentText()},
+                                     {"baud", baud}})) {
+            return;
+        }
+        UARTBootloader *uart = new UARTBootloader(ui->portComboBox->currentText(), baud, startAddress, eraseBlockSize);
+        uart->setNativeSerial(ui->actionNative_serial->isChecked());
+        bootloader.reset(uart);
         if (bootloader->isConnected()) {
             connectLabel->setText(QString("Connected: %1 %2 baud")
                                   .arg(ui->portComboBox->currentText()).arg(baud));
@@ -163,15 +258,118 @@ void MainWindow::on_connectButton_clicked()
                                   .arg(ui->portComboBox->currentText()));
         }
     }
-    if (bootloader->isConnected()) {
-        connect(bootloader.get(), &Bootloader::message, this, &MainWindow::onMessage);
-        connect(bootloader.get(), &Bootloader::progress, this, &MainWindow::onProgress);
-        connect(bootloader.get(), &Bootloader::finished, this, &MainWindow::onBootloaderFinished);
+#ifdef Q_OS_LINUX
+    else if (ui->connectionTypeComboBox->currentText() == "CAN") {
+        bool ok;
+        uint32_t startAddress = ui->appStartEdit->text().toUInt(&ok, 16);
+        if (!ok && ui->fileNameEdit->text().endsWith(".bin", Qt::CaseInsensitive)) {
+            QMessageBox::critical(this, QApplication::applicationName(), "Invalid start address - Enter in hex");
+            return;
+        }
+        uint32_t eraseBlockSize = ui->eraseSizeEdit->text().toUInt(&ok, 10);
+        if (!ok || eraseBlockSize == 0 || eraseBlockSize > 0xffff) {
+            QMessageBox::critical(this, QApplication::applicationName(), "Invalid erase block size - Enter in decimal");
+            return;
+        }
+        if (startTrigger(QJsonObject{{"connection", "CAN"}, {"port", ui->portComboBox->currentText()}})) {
+            return;
+        }
+        //The boot info read waits out a silent node, finishes in onCanConnected
+        bootloader = nullptr;
+        ui->connectButton->setEnabled(false);
+        ui->programButton->setEnabled(false);
+        connectLabel->setText("Connecting...");
+        deviceService.connectCan(ui->portComboBox->currentText(), ui->actionCAN_FD->isChecked(),
+                                 startAddress, eraseBlockSize);
+        return;
+    }
+#endif
+    connectFinished();
+}
+
+void MainWindow::onHidConnected(Bootloader *hid, int version)
+{
+    ui->connectButton->setEnabled(true);
+    bootloader.reset(hid);
+    if (bootloader) {
+        connectLabel->setText(QString("Connected: VID = %1 PID = %2 Bootloader Version = %3.%4")
+                              .arg(ui->vidEdit->text(), ui->pidEdit->text())
+                              .arg(version >> 8).arg(version & 0xff));
+    } else {
+        QMessageBox::critical(this, QApplication::applicationName()
+                              , QString("Unable to open device with vid=%1, pid=%2")
+                                .arg(ui->vidEdit->text(), ui->pidEdit->text()));
+    }
+    connectFinished();
+}
+
+void MainWindow::onCanConnected(Bootloader *can, int version)
+{
+    ui->connectButton->setEnabled(true);
+    bootloader.reset(can);
+    if (bootloader) {
+        connectLabel->setText(QString("Connected: %1 %2 Bootloader Version = %3.%4")
+                              .arg(ui->portComboBox->currentText(), ui->actionCAN_FD->isChecked() ? "CAN-FD" : "CAN")
+                              .arg(version >> 8).arg(version & 0xff));
+    } else {
+        QMessageBox::critical(this, QApplication::applicationName()
+                              , QString("Unable to open CAN interface: %1")
+                              .arg(ui->portComboBox->currentText()));
+    }
+    connectFinished();
+}
+
+bool MainWindow::startTrigger(const QJsonObject &target)
+{
+    //The second time through, from onBootloaderTriggered, the bootloader is
+    //already up and the connect goes ahead
+    if (triggerDone) {
+        triggerDone = false;
+        return false;
+    }
+    triggerReport.clear();
+    int index = triggerGroup->checkedAction() ? triggerGroup->checkedAction()->data().toInt() : -1;
+    if (index < 0 || index >= deviceService.triggers().size()) {
+        return false;
+    }
+    bootloader = nullptr;
+    ui->connectButton->setEnabled(false);
+    ui->programButton->setEnabled(false);
+    connectLabel->setText("Entering bootloader...");
+    deviceService.triggerBootloader(deviceService.triggers()[index].toObject(), target);
+    return true;
+}
+
+void MainWindow::onBootloaderTriggered(bool success, QString report)
+{
+    ui->connectButton->setEnabled(true);
+    if (!success) {
+        connectLabel->setText("Not connected");
+        QMessageBox::critical(this, QApplication::applicationName(),
+                              QString("Bootloader entry failed: %1").arg(report));
+        return;
+    }
+    //Connect straight away, the time to a working link is part of the report
+    triggerDone = true;
+    triggerReport = report;
+    connectTimer.start();
+    on_connectButton_clicked();
+}
+
+void MainWindow::connectFinished()
+{
+    if (bootloader && bootloader->isConnected()) {
+        connectBootloader();
         ui->programButton->setEnabled(true);
     } else {
         connectLabel->setText("Not connected");
         ui->programButton->setEnabled(false);
     }
+    if (!triggerReport.isEmpty()) {
+        ui->statusbar->showMessage(QString("%1, connect %2 ms").arg(triggerReport)
+                                   .arg(connectTimer.nsecsElapsed() / 1e6, 0, 'f', 1), 0);
+        triggerReport.clear();
+    }
 }
 
 void MainWindow::onMessage(QString msg)
@@ -186,17 +384,34 @@ void MainWindow::onProgress(int progress)
 
 void MainWindow::onBootloaderFinished(bool success)
 {
+    QString summary;
     if (worker) {
         worker->wait();
+        summary = worker->statsSummary();
         worker = nullptr;
     }
+    if (replayMismatches) {
+        ui->statusbar->showMessage(QString("Replay %1 in %2 ms, %3 frames differ from the trace")
+                                   .arg(success ? "completed" : "failed")
+                                   .arg(jobTimer.elapsed()).arg(replayMismatches()), 0);
+        replayMismatches = nullptr;
+        bootloader = nullptr;
+        connectLabel->setText("Not Connected");
+        return;
+    }
     if (success) {
-        ui->statusbar->showMessage("Programming completed", 0);
+        //Measured link timing, used by the flash plan estimates
+        QString type = ui->connectionTypeComboBox->currentText();
+        if (bootloader && bootloader->roundTripMs() > 0 && (type == "USB" || type == "UART")) {
+            QSettings().setValue(type == "USB" ? "hid_frame_ms" : "uart_rtt_ms", bootloader->roundTripMs());
+        }
+        ui->statusbar->showMessage(QString("Programming completed - %1").arg(summary), 0);
         connectLabel->setText("Not Connected");
     } else {
         ui->programButton->setEnabled(true);
         ui->statusbar->showMessage("Programming failed", 0);
     }
+    stopTrace();
 }
 
 
@@ -208,6 +423,18 @@ void MainWindow::on_programButton_clicked()
         return;
     }
     bootloader->setFamily(ui->familyComboBox->currentData().toInt());
+    if (ui->actionBlank_check->isChecked() && partFlashKb > 0) {
+        QJsonObject family = familiesArray[ui->familyComboBox->currentIndex()].toObject();
+        uint32_t appStart = family["app start address"].toString().toUInt(nullptr, 16);
+        bootloader->setBlankCheck(appStart, appLength(family, appStart, partFlashKb * 1024));
+    } else {
+        //Reading past the end of flash can fault the bootloader, so without
+        //the size of the exact part there is no blank check
+        if (ui->actionBlank_check->isChecked()) {
+            ui->statusbar->showMessage("Blank check skipped, set the part flash size under Options", 5000);
+        }
+        bootloader->setBlankCheck(0, 0);
+    }
     ui->programButton->setEnabled(false);
     if (!bootloader->setFile(ui->fileNameEdit->text())) {
         QMessageBox::critical(this, QApplication::applicationName()
@@ -218,7 +445,11 @@ void MainWindow::on_programButton_clicked()
         return;
     }
     ui->progressBar->setValue(0);
+    startTrace();
+    jobTimer.start();
     worker.reset(new WorkerThread(bootloader.get()));
+    worker->setVerifyFirst(ui->actionVerify_first->isChecked());
+    worker->setRealtime(ui->actionRealtime->isChecked(), realtimeCore);
     worker->start();
 }
 
@@ -244,24 +475,22 @@ void MainWindow::on_actionAbout_triggered()
 
 void MainWindow::on_fileNameEdit_textChanged(const QString &arg1)
 {
-    if (ui->connectionTypeComboBox->currentText() == "UART") {
+    preloadTimer.start();
+    if (ui->connectionTypeComboBox->currentText() != "USB") {
         if (arg1.endsWith(".hex", Qt::CaseInsensitive)) {
             ui->statusbar->showMessage("Using hex file for flash start address", 3000);
         }
     }
 }
 
-void MainWindow::readDevices()
+void MainWindow::onFamiliesLoaded()
 {
-    QString val;
-    QFile file;
-    file.setFileName("devices.json");
-    file.open(QIODevice::ReadOnly | QIODevice::Text);
-    val = file.readAll();
-    file.close();
-    QJsonDocument d = QJsonDocument::fromJson(val.toUtf8());
-    QJsonObject jobj = d.object();
-    familiesArray = jobj["families"].toArray();
+    //Selecting a family fills in its defaults, keep what was restored from
+    //the settings or typed in while the file was loading
+    QSettings settings;
+    QString appStart = ui->appStartEdit->text();
+    QString eraseSize = ui->eraseSizeEdit->text();
+    familiesArray = deviceService.families();
     int baseFamily;
     for (int i = 0; i < familiesArray.size(); ++i) {
         if (familiesArray[i].toObject()["base family"].toString() == "ARM") {
@@ -275,11 +504,32 @@ void MainWindow::readDevices()
         ui->familyComboBox->addItem(familiesArray[i].toObject()["name"].toString(),
                 baseFamily);
     }
+    ui->familyComboBox->setCurrentIndex(
+                settings.value("last_family_index", 0).toInt());
+    ui->appStartEdit->setText(appStart);
+    ui->eraseSizeEdit->setText(eraseSize);
+
+    QString profile = settings.value("trigger_profile").toString();
+    QJsonArray triggers = deviceService.triggers();
+    ui->actionManual_entry->setChecked(true);
+    for (int i = 0; i < triggers.size(); ++i) {
+        QAction *action = ui->menuBootloader_entry->addAction(triggers[i].toObject()["name"].toString());
+        action->setCheckable(true);
+        action->setData(i);
+        triggerGroup->addAction(action);
+        if (action->text() == profile) {
+            action->setChecked(true);
+        }
+    }
 }
 
 
 void MainWindow::on_familyComboBox_currentIndexChanged(int index)
 {
+    if (index < 0 || index >= familiesArray.size()) {
+        return;
+    }
+    preloadTimer.start();
     ui->appStartEdit->setText(familiesArray[index].toObject()["app start address"].toString());
     ui->eraseSizeEdit->setText(QString::number(familiesArray[index].toObject()["erase block size"].toInt()));
     if (ui->fileNameEdit->text().endsWith(".hex", Qt::CaseInsensitive)) {
@@ -287,3 +537,214 @@ void MainWindow::on_familyComboBox_currentIndexChanged(int index)
     }
 }
 
+
+void MainWindow::on_actionReplay_trace_triggered()
+{
+    if (worker) {
+        return;
+    }
+    QString traceFile = QFileDialog::getOpenFileName(this, "Open trace file",
+                                                     QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+                                                     + "/traces", "trace files (*.hbt)");
+    if (traceFile == "") {
+        return;
+    }
+    QJsonObject meta;
+    QList<TraceFrame> frames;
+    if (!TraceRecorder::load(traceFile, meta, frames)) {
+        QMessageBox::critical(this, QApplication::applicationName(), "Unable to read trace file");
+        return;
+    }
+    if (meta["type"].toString() == "CAN") {
+        QMessageBox::critical(this, QApplication::applicationName(), "CAN traces cannot be replayed");
+        return;
+    }
+    if (meta["type"].toString() == "USB") {
+        //Report sizes decide how records were packed, older traces are 64 bytes
+        TraceReplayLink *link = new TraceReplayLink(frames,
+                meta["input report size"].toInt(HidLink::DEFAULT_REPORT_SIZE),
+                meta["output report size"].toInt(HidLink::DEFAULT_REPORT_SIZE));
+        bootloader.reset(new HidBootloader(link));
+        replayMismatches = [link]() {return link->mismatches();};
+    } else {
+        TraceReplayDevice *device = new TraceReplayDevice(frames);
+        UARTBootloader *uart = new UARTBootloader("Replay", meta["baud"].toInt(),
+                meta["start address"].toString().toUInt(nullptr, 16), meta["erase block size"].toInt());
+        uart->setTransport(device);
+        bootloader.reset(uart);
+        replayMismatches = [device]() {return device->mismatches();};
+    }
+    connectBootloader();
+    bootloader->setFamily(meta["family"].toInt());
+    if (!bootloader->setFile(meta["file"].toString())) {
+        QMessageBox::critical(this, QApplication::applicationName(),
+                              QString("Unable to open firmware file %1 used by the trace")
+                              .arg(meta["file"].toString()));
+        replayMismatches = nullptr;
+        bootloader = nullptr;
+        return;
+    }
+    connectLabel->setText(QString("Replaying %1").arg(QFileInfo(traceFile).fileName()));
+    ui->programButton->setEnabled(false);
+    ui->progressBar->setValue(0);
+    jobTimer.start();
+    worker.reset(new WorkerThread(bootloader.get()));
+    worker->start();
+}
+
+void MainWindow::on_actionRealtime_core_triggered()
+{
+    bool ok;
+    int core = QInputDialog::getInt(this, QApplication::applicationName(),
+                                    "CPU core for the transfer thread (-1 for any):",
+                                    realtimeCore, -1, QThread::idealThreadCount() - 1, 1, &ok);
+    if (ok) {
+        realtimeCore = core;
+    }
+}
+
+void MainWindow::on_actionPart_flash_size_triggered()
+{
+    bool ok;
+    int kb = QInputDialog::getInt(this, QApplication::applicationName(),
+                                  "Flash size of the part on the board in KB (0 if not known):",
+                                  partFlashKb, 0, 4 * 1024 * 1024, 1, &ok);
+    if (ok) {
+        partFlashKb = kb;
+    }
+}
+
+void MainWindow::on_actionFlash_plan_triggered()
+{
+    if (ui->familyComboBox->currentText() == "" || ui->fileNameEdit->text() == "") {
+        QMessageBox::critical(this, QApplication::applicationName(),
+                              "Please select a device family and firmware file");
+        return;
+    }
+    QSettings settings;
+    QJsonObject family = familiesArray[ui->familyComboBox->currentIndex()].toObject();
+    uint32_t appStart = ui->appStartEdit->text().toUInt(nullptr, 16);
+    uint32_t eraseBlockSize = ui->eraseSizeEdit->text().toUInt();
+    LinkProfile link;
+    link.baud = ui->baudComboBox->currentText().toInt();
+    if (link.baud <= 0) {
+        link.baud = 115200;
+    }
+    //Last measured timings, or typical full speed USB and local serial values
+    link.uartRttMs = settings.value("uart_rtt_ms", 1.0).toDouble();
+    link.hidFrameMs = settings.value("hid_frame_ms", 2.0).toDouble();
+    link.hidReportSize = HidLink::DEFAULT_REPORT_SIZE;
+    if (bootloader && ui->connectionTypeComboBox->currentText() == "USB") {
+        link.hidReportSize = bootloader->linkInfo()["output report size"].toInt(HidLink::DEFAULT_REPORT_SIZE);
+    }
+    link.eraseBlockMs = family["erase block ms"].toDouble(20);
+    link.appLength = appLength(family, appStart, partFlashKb * 1024);
+    FlashPlan plan;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool ok = plan.analyse(ui->fileNameEdit->text(), ui->familyComboBox->currentData().toInt(),
+                           appStart, eraseBlockSize, link);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        QMessageBox::critical(this, QApplication::applicationName(), plan.errorString());
+        return;
+    }
+    QMessageBox box(plan.warnings().isEmpty() ? QMessageBox::Information : QMessageBox::Warning,
+                    "Flash plan", plan.summary(), QMessageBox::Ok, this);
+    box.setDetailedText(plan.report());
+    box.exec();
+}
+
+uint32_t MainWindow::appLength(const QJsonObject &family, uint32_t appStart, uint32_t flashSize)
+{
+    //From the app start to the end of flash on a part with flashSize bytes,
+    //0 if that is not known or the start is outside its flash
+    uint32_t flashStart = family["flash start"].toString().toUInt(nullptr, 16);
+    uint64_t flashEnd = flashStart + (uint64_t)flashSize;
+    if (!family.contains("flash start") || appStart < flashStart || appStart >= flashEnd) {
+        return 0;
+    }
+    return flashEnd - appStart;
+}
+
+void MainWindow::on_actionDashboard_triggered()
+{
+    if (!dashboard) {
+        QSettings settings;
+        dashboard = new Dashboard(settings.value("daemon_socket", "harmonybootloader").toString(), this);
+        dashboard->setAttribute(Qt::WA_DeleteOnClose);
+    }
+    dashboard->show();
+    dashboard->raise();
+    dashboard->activateWindow();
+}
+
+void MainWindow::connectBootloader()
+{
+    connect(bootloader.get(), &Bootloader::message, this, &MainWindow::onMessage);
+    connect(bootloader.get(), &Bootloader::progress, this, &MainWindow::onProgress);
+    connect(bootloader.get(), &Bootloader::finished, this, &MainWindow::onBootloaderFinished);
+}
+
+void MainWindow::startTrace()
+{
+    if (!ui->actionRecord_trace->isChecked()) {
+        return;
+    }
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/traces";
+    QDir().mkpath(dir);
+    QString traceFile = QString("%1/trace-%2.hbt").arg(dir,
+                            QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    //Everything needed to rebuild the same session for replay
+    QJsonObject meta;
+    meta["type"] = ui->connectionTypeComboBox->currentText();
+    meta["file"] = ui->fileNameEdit->text();
+    meta["family"] = ui->familyComboBox->currentData().toInt();
+    meta["baud"] = ui->baudComboBox->currentText().toInt();
+    meta["start address"] = ui->appStartEdit->text();
+    meta["erase block size"] = ui->eraseSizeEdit->text().toInt();
+    QJsonObject linkInfo = bootloader->linkInfo();
+    for (auto it = linkInfo.constBegin(); it != linkInfo.constEnd(); ++it) {
+        meta[it.key()] = it.value();
+    }
+    traceRecorder.reset(new TraceRecorder());
+    if (!traceRecorder->open(traceFile, meta)) {
+        traceRecorder = nullptr;
+        ui->statusbar->showMessage("Unable to create trace file", 3000);
+        return;
+    }
+    bootloader->setTraceRecorder(traceRecorder.get());
+}
+
+void MainWindow::stopTrace()
+{
+    if (!traceRecorder) {
+        return;
+    }
+    if (bootloader) {
+        bootloader->setTraceRecorder(nullptr);
+    }
+    traceRecorder->close();
+    ui->statusbar->showMessage(QString("%1 - trace saved to %2 (%3 frames dropped)")
+                               .arg(ui->statusbar->currentMessage(), traceRecorder->fileName())
+                               .arg(traceRecorder->droppedFrames()), 0);
+    traceRecorder = nullptr;
+}
+
+void MainWindow::preloadImage()
+{
+    //Same cache key the bootloader will ask for when Program is pressed
+    QStringList files = ImageBuilder::splitFileList(ui->fileNameEdit->text());
+    bool physical = FamilyPolicy::forFamily(ui->familyComboBox->currentData().toInt()).physicalAddresses;
+    uint32_t eraseBlockSize = 0;
+    if (ui->connectionTypeComboBox->currentText() != "USB") {
+        eraseBlockSize = ui->eraseSizeEdit->text().toUInt();
+        for (auto &i : files) {
+            if (i.endsWith(".bin", Qt::CaseInsensitive)) {
+                i += QString("@%1").arg(ui->appStartEdit->text().toUInt(nullptr, 16), 0, 16);
+            }
+        }
+    }
+    if (!files.isEmpty()) {
+        ImageCache::instance().preload(files.join(";"), physical, eraseBlockSize);
+    }
+}
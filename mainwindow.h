@@ -2,10 +2,18 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QActionGroup>
 #include <QLabel>
 #include <QJsonArray>
 #include "bootloader.h"
 #include "workerthread.h"
+#include "tracerecorder.h"
+#include "deviceservice.h"
+#include "dashboard.h"
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QPointer>
+#include <functional>
 #include <memory>
 
 QT_BEGIN_NAMESPACE
@@ -16,7 +24,8 @@ class MainWindow : public QMainWindow
 {
     Q_OBJECT
 public:
-    MainWindow(QWidget *parent = nullptr);
+    //simulatorPort lists the in-process UART target with the serial ports
+    MainWindow(QWidget *parent = nullptr, bool simulatorPort = false);
     ~MainWindow();
 private slots:
     void on_connectionTypeComboBox_currentTextChanged(const QString &arg1);
@@ -32,6 +41,16 @@ private slots:
     void on_fileNameEdit_textChanged(const QString &arg1);
 
     void on_familyComboBox_currentIndexChanged(int index);
+    void on_actionReplay_trace_triggered();
+    void on_actionRealtime_core_triggered();
+    void on_actionPart_flash_size_triggered();
+    void on_actionFlash_plan_triggered();
+    void on_actionDashboard_triggered();
+    void onFamiliesLoaded();
+    void onPortsChanged();
+    void onHidConnected(Bootloader *hid, int version);
+    void onCanConnected(Bootloader *can, int version);
+    void onBootloaderTriggered(bool success, QString report);
 
 private:
     QString fileName;
@@ -39,8 +58,27 @@ private:
     Ui::MainWindow *ui;
     std::unique_ptr<Bootloader> bootloader;
     std::unique_ptr<WorkerThread> worker;
-    void readDevices();
     QJsonArray familiesArray;
+    DeviceService deviceService;
+    std::unique_ptr<TraceRecorder> traceRecorder;
+    std::function<int()> replayMismatches;
+    QElapsedTimer jobTimer;
+    QTimer preloadTimer;
+    int realtimeCore;
+    bool simulatorPort;
+    int partFlashKb;        //flash of the part on the board, 0 when not given
+    QPointer<Dashboard> dashboard;
+    QActionGroup *triggerGroup;
+    bool triggerDone;
+    QString triggerReport;
+    QElapsedTimer connectTimer;
+    void preloadImage();
+    static uint32_t appLength(const QJsonObject &family, uint32_t appStart, uint32_t flashSize);
+    bool startTrigger(const QJsonObject &target);
+    void connectBootloader();
+    void connectFinished();
+    void startTrace();
+    void stopTrace();
 protected:
     virtual void closeEvent(QCloseEvent *event) override;
 };
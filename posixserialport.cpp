@@ -0,0 +1,162 @@
+#include "posixserialport.h"
+#include <QFile>
+#include <QElapsedTimer>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+//termios2 lives in the kernel headers, <termios.h> would clash with it
+#include <asm/termbits.h>
+
+PosixSerialPort::PosixSerialPort(QString portName, int baud) :
+    QIODevice(), m_portName(portName), m_baud(baud), m_actualBaud(0), m_fd(-1)
+{
+    //Accept COM style names from the port list as well as full paths
+    if (!m_portName.startsWith("/")) {
+        m_portName = "/dev/" + m_portName;
+    }
+}
+
+PosixSerialPort::~PosixSerialPort()
+{
+    close();
+}
+
+bool PosixSerialPort::open(OpenMode mode)
+{
+    if (m_fd >= 0) {
+        return false;
+    }
+    m_fd = ::open(QFile::encodeName(m_portName).constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        setErrorString(QString("Unable to open %1: %2").arg(m_portName, strerror(errno)));
+        return false;
+    }
+    if (ioctl(m_fd, TIOCEXCL) < 0 || !configure()) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void PosixSerialPort::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    if (isOpen()) {
+        QIODevice::close();
+    }
+}
+
+bool PosixSerialPort::configure()
+{
+    struct termios2 tio;
+    if (ioctl(m_fd, TCGETS2, &tio) < 0) {
+        setErrorString(QString("%1 is not a serial port").arg(m_portName));
+        return false;
+    }
+    //Raw 8N1, no flow control.  BOTHER takes the rate from c_ospeed/c_ispeed
+    //so non-standard rates work on adapters that support them.
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ospeed = m_baud;
+    tio.c_ispeed = m_baud;
+    //Responses are single bytes.  With VMIN 1 and no VTIME the tty reports
+    //readable on the first byte instead of waiting for an inter-byte timer.
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(m_fd, TCSETS2, &tio) < 0 || ioctl(m_fd, TCGETS2, &tio) < 0) {
+        setErrorString(QString("Unable to set %1 baud on %2").arg(m_baud).arg(m_portName));
+        return false;
+    }
+    //Drivers round to the nearest rate they can generate, more than 3%
+    //off will not frame reliably
+    m_actualBaud = tio.c_ospeed;
+    if (qAbs(m_actualBaud - m_baud) * 100 > m_baud * 3) {
+        setErrorString(QString("%1 cannot run at %2 baud").arg(m_portName).arg(m_baud));
+        return false;
+    }
+    //Not every driver has the flag, the port still works without it
+    struct serial_struct serial;
+    if (ioctl(m_fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        (void) ioctl(m_fd, TIOCSSERIAL, &serial);
+    }
+    ioctl(m_fd, TCFLSH, TCIOFLUSH);
+    return true;
+}
+
+qint64 PosixSerialPort::bytesAvailable() const
+{
+    int available = 0;
+    if (m_fd >= 0 && ioctl(m_fd, FIONREAD, &available) < 0) {
+        available = 0;
+    }
+    return available + QIODevice::bytesAvailable();
+}
+
+bool PosixSerialPort::waitFor(short events, int msecs)
+{
+    struct pollfd fds = {m_fd, events, 0};
+    QElapsedTimer timer;
+    timer.start();
+    for (;;) {
+        int remaining = msecs < 0 ? -1 : qMax(0, msecs - (int)timer.elapsed());
+        int ret = poll(&fds, 1, remaining);
+        if (ret > 0) {
+            return (fds.revents & events) != 0;
+        }
+        if (ret == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool PosixSerialPort::waitForReadyRead(int msecs)
+{
+    return m_fd >= 0 && waitFor(POLLIN, msecs);
+}
+
+bool PosixSerialPort::waitForBytesWritten(int msecs)
+{
+    //writeData hands everything to the driver before returning
+    (void) msecs;
+    return m_fd >= 0;
+}
+
+qint64 PosixSerialPort::readData(char *data, qint64 maxSize)
+{
+    ssize_t len = ::read(m_fd, data, maxSize);
+    if (len < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    return len;
+}
+
+qint64 PosixSerialPort::writeData(const char *data, qint64 maxSize)
+{
+    qint64 written = 0;
+    while (written < maxSize) {
+        ssize_t len = ::write(m_fd, data + written, maxSize - written);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN || !waitFor(POLLOUT, 1000)) {
+                setErrorString(QString("Write failed on %1").arg(m_portName));
+                return written > 0 ? written : -1;
+            }
+            continue;
+        }
+        written += len;
+    }
+    return written;
+}
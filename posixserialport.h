@@ -0,0 +1,36 @@
+#ifndef POSIXSERIALPORT_H
+#define POSIXSERIALPORT_H
+
+#include <QIODevice>
+#include <QString>
+
+//Serial port driven directly through termios2 on Linux.  QSerialPort leaves
+//the driver defaults alone, which on FTDI and CP210x adapters holds every
+//response back for the adapter latency timer (up to 16 ms).  This backend
+//sets ASYNC_LOW_LATENCY, wakes on the first received byte and accepts any
+//baud rate the adapter can generate (921600, 2M, 3M).
+class PosixSerialPort : public QIODevice
+{
+public:
+    PosixSerialPort(QString portName, int baud);
+    ~PosixSerialPort();
+    virtual bool open(OpenMode mode) override;
+    virtual void close() override;
+    virtual bool isSequential() const override {return true;}
+    virtual qint64 bytesAvailable() const override;
+    virtual bool waitForReadyRead(int msecs) override;
+    virtual bool waitForBytesWritten(int msecs) override;
+    int actualBaudRate() const {return m_actualBaud;}
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize) override;
+    virtual qint64 writeData(const char *data, qint64 maxSize) override;
+private:
+    QString m_portName;
+    int m_baud;
+    int m_actualBaud;
+    int m_fd;
+    bool configure();
+    bool waitFor(short events, int msecs);
+};
+
+#endif // POSIXSERIALPORT_H
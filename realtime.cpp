@@ -0,0 +1,172 @@
+#include "realtime.h"
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+#ifdef Q_OS_WIN
+#include <Windows.h>
+#endif
+
+#ifdef Q_OS_LINUX
+//Not wrapped by glibc.  Who 1 (IOPRIO_WHO_PROCESS) with id 0 is the
+//calling thread.
+static int ioprioSet(int ioprio)
+{
+    return syscall(SYS_ioprio_set, 1, 0, ioprio);
+}
+static int ioprioGet()
+{
+    return syscall(SYS_ioprio_get, 1, 0);
+}
+static const int IOPRIO_CLASS_SHIFT = 13;
+static const int IOPRIO_CLASS_RT = 1;
+static const int IOPRIO_CLASS_BE = 2;
+
+//Memory locks belong to the process, not the thread, and several jobs can
+//run at once (the daemon has one per port).  Memory stays locked until the
+//last of them ends.
+static QMutex lockMutex;
+static int lockCount = 0;
+
+static bool lockMemory()
+{
+    //Locks what is mapped now, which includes the buffers set up for the
+    //job.  No MCL_FUTURE, later allocations anywhere in the process would
+    //fail with ENOMEM once RLIMIT_MEMLOCK is reached.
+    QMutexLocker lock(&lockMutex);
+    if (mlockall(MCL_CURRENT) != 0) {
+        return false;
+    }
+    ++lockCount;
+    return true;
+}
+
+static void unlockMemory()
+{
+    QMutexLocker lock(&lockMutex);
+    if (--lockCount == 0) {
+        munlockall();
+    }
+}
+#endif
+
+RealtimeScope::RealtimeScope(int core) :
+    m_locked(false), m_oldPolicy(0), m_oldPriority(0), m_oldNice(0), m_oldIoprio(-1), m_affinitySaved(false)
+{
+#ifdef Q_OS_LINUX
+    struct sched_param param;
+    pthread_getschedparam(pthread_self(), &m_oldPolicy, &param);
+    m_oldPriority = param.sched_priority;
+    errno = 0;
+    m_oldNice = getpriority(PRIO_PROCESS, syscall(SYS_gettid));
+    param.sched_priority = FIFO_PRIORITY;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) {
+        m_applied << "SCHED_FIFO";
+    } else if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), NICE_LEVEL) == 0) {
+        //No CAP_SYS_NICE or rtprio limit, a raised nice level still helps
+        m_applied << QString("nice %1").arg(NICE_LEVEL);
+    } else {
+        m_applied << "normal priority (no permission)";
+    }
+    m_oldIoprio = ioprioGet();
+    if (ioprioSet(IOPRIO_CLASS_RT << IOPRIO_CLASS_SHIFT) == 0) {
+        m_applied << "real-time I/O class";
+    } else if (ioprioSet(IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) == 0) {
+        m_applied << "highest best-effort I/O priority";
+    }
+    if (core >= CPU_SETSIZE) {
+        m_applied << QString("core %1 unavailable").arg(core);
+    } else if (core >= 0) {
+        cpu_set_t set;
+        m_oldAffinity.resize(sizeof(cpu_set_t));
+        m_affinitySaved = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                                 (cpu_set_t *)m_oldAffinity.data()) == 0;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            m_applied << QString("core %1").arg(core);
+        } else {
+            m_applied << QString("core %1 unavailable").arg(core);
+        }
+    }
+    //Page faults in the transfer loop would cost more than the rest together
+    if (lockMemory()) {
+        m_locked = true;
+        m_applied << "memory locked";
+    } else {
+        m_applied << "memory not locked (RLIMIT_MEMLOCK)";
+    }
+#elif defined(Q_OS_WIN)
+    m_oldPriority = GetThreadPriority(GetCurrentThread());
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        m_applied << "time critical priority";
+    }
+    if (core >= (int)sizeof(DWORD_PTR) * 8) {
+        m_applied << QString("core %1 unavailable").arg(core);
+    } else if (core >= 0) {
+        DWORD_PTR old = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+        if (old) {
+            m_oldAffinity.resize(sizeof(old));
+            memcpy(m_oldAffinity.data(), &old, sizeof(old));
+            m_affinitySaved = true;
+            m_applied << QString("core %1").arg(core);
+        } else {
+            m_applied << QString("core %1 unavailable").arg(core);
+        }
+    }
+#else
+    (void) core;
+    m_applied << "not supported on this platform";
+#endif
+}
+
+RealtimeScope::~RealtimeScope()
+{
+#ifdef Q_OS_LINUX
+    if (m_locked) {
+        unlockMemory();
+    }
+    if (m_affinitySaved) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t *)m_oldAffinity.data());
+    }
+    struct sched_param param;
+    param.sched_priority = m_oldPriority;
+    pthread_setschedparam(pthread_self(), m_oldPolicy, &param);
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), m_oldNice);
+    if (m_oldIoprio >= 0) {
+        ioprioSet(m_oldIoprio);
+    }
+#elif defined(Q_OS_WIN)
+    if (m_affinitySaved) {
+        DWORD_PTR old;
+        memcpy(&old, m_oldAffinity.constData(), sizeof(old));
+        SetThreadAffinityMask(GetCurrentThread(), old);
+    }
+    SetThreadPriority(GetCurrentThread(), m_oldPriority);
+#endif
+}
+
+WakeupLatency RealtimeScope::measureWakeup(int samples)
+{
+    //Same kind of wait as a transfer: block, get woken, see how late it was
+    QVector<qint64> late;
+    late.reserve(samples);
+    QElapsedTimer timer;
+    for (int i = 0; i < samples; ++i) {
+        timer.start();
+        QThread::usleep(PROBE_SLEEP_US);
+        late.append(qMax(0LL, timer.nsecsElapsed() / 1000 - PROBE_SLEEP_US));
+    }
+    std::sort(late.begin(), late.end());
+    WakeupLatency result = {late[samples / 2], late[qMin(samples - 1, samples * 99 / 100)]};
+    return result;
+}
@@ -0,0 +1,37 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+typedef struct {
+    qint64 p50Us;
+    qint64 p99Us;
+} WakeupLatency;
+
+//Raises the calling thread to real-time scheduling, pins it to a core and
+//locks the process memory mapped so far for the duration of a job.  Each step falls back on its own
+//when the process lacks the permission, and what was applied is reported.
+class RealtimeScope
+{
+public:
+    //core < 0 leaves the affinity alone
+    explicit RealtimeScope(int core);
+    ~RealtimeScope();
+    QString description() const {return m_applied.join(", ");}
+    //How late the calling thread wakes from short sleeps
+    static WakeupLatency measureWakeup(int samples = PROBE_SAMPLES);
+    enum {PROBE_SAMPLES = 100, PROBE_SLEEP_US = 1000, FIFO_PRIORITY = 50, NICE_LEVEL = -10};
+private:
+    QStringList m_applied;
+    bool m_locked;
+    int m_oldPolicy;
+    int m_oldPriority;
+    int m_oldNice;
+    int m_oldIoprio;
+    bool m_affinitySaved;
+    QVector<unsigned char> m_oldAffinity;
+};
+
+#endif // REALTIME_H
@@ -0,0 +1,264 @@
+#include "sessionmodel.h"
+
+SessionModel::SessionModel(QObject *parent) : QAbstractTableModel(parent),
+    m_dirtyFirstColumn(COLUMNS), m_dirtyLastColumn(-1)
+{
+    m_clock.start();
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FRAME_MS);
+    connect(&m_flushTimer, &QTimer::timeout, this, &SessionModel::flush);
+}
+
+int SessionModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_sessions.size();
+}
+
+int SessionModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : (int)COLUMNS;
+}
+
+QVariant SessionModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_sessions.size()) {
+        return QVariant();
+    }
+    const Session &session = m_sessions[index.row()];
+    if (role == Qt::TextAlignmentRole) {
+        switch (index.column()) {
+        case JOB:
+        case THROUGHPUT:
+        case ETA:
+        case RETRIES:
+            return (int)(Qt::AlignRight | Qt::AlignVCenter);
+        default:
+            return QVariant();
+        }
+    }
+    if (role == Qt::ToolTipRole && (index.column() == PHASE || index.column() == RESULT)) {
+        return index.column() == PHASE ? session.phase : session.result;
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    switch (index.column()) {
+    case STATION:
+        return session.station;
+    case JOB:
+        return session.job > 0 ? QVariant(session.job) : QVariant();
+    case STATE:
+        if (session.pending > 0) {
+            return QString("%1 (+%2 queued)").arg(stateName(session.state)).arg(session.pending);
+        }
+        return stateName(session.state);
+    case PHASE:
+        return session.phase;
+    case PROGRESS:
+        //Drawn as a bar by the view
+        return session.percent;
+    case THROUGHPUT:
+        return session.throughput > 0 ? QString("%1 KB/s").arg(session.throughput / 1024, 0, 'f', 1) : QString();
+    case ETA:
+        return session.state == RUNNING && session.etaSeconds >= 0 ? formatEta(session.etaSeconds) : QString();
+    case RETRIES:
+        return session.retries;
+    case RESULT:
+        return session.result;
+    }
+    return QVariant();
+}
+
+QVariant SessionModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    static const char *names[COLUMNS] = {"Station", "Job", "State", "Phase", "Progress",
+                                         "Throughput", "ETA", "Retries", "Result"};
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section >= 0 && section < COLUMNS) {
+        return QString(names[section]);
+    }
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void SessionModel::applyEvent(const QJsonObject &event)
+{
+    //Events without a port (status, errors about requests) are not about a station
+    QString station = event["port"].toString();
+    if (station.isEmpty()) {
+        return;
+    }
+    QString type = event["event"].toString();
+    int job = event["job"].toInt();
+    int r = row(station);
+    Session &session = m_sessions[r];
+    if (type == "finished" && job != session.job && session.state != QUEUED && session.state != RUNNING) {
+        //A job queued behind the last one ended without starting, opening
+        //its link or image failed or it was cancelled meanwhile.  It is
+        //the station's latest result, so the row takes it over.
+        if (session.pending > 0) {
+            --session.pending;
+        }
+        session.job = job;
+        session.phase.clear();
+        session.percent = 0;
+        session.throughput = 0;
+        markDirty(r, JOB, RESULT);
+    }
+    if (type == "queued") {
+        if (session.state == QUEUED || session.state == RUNNING) {
+            ++session.pending;
+            markDirty(r, STATE, STATE);
+            return;
+        }
+        session.job = job;
+        session.state = QUEUED;
+        session.phase.clear();
+        session.percent = 0;
+        session.throughput = 0;
+        session.etaSeconds = -1;
+        session.result.clear();
+        markDirty(r, JOB, RESULT);
+    } else if (type == "started") {
+        if (job != session.job && session.pending > 0) {
+            --session.pending;
+        }
+        session.job = job;
+        session.state = RUNNING;
+        session.phase.clear();
+        session.percent = 0;
+        session.bytes = event["bytes"].toVariant().toLongLong();
+        session.programStartedMs = -1;
+        session.throughput = 0;
+        session.etaSeconds = -1;
+        session.retries = session.lastFailed ? session.retries + 1 : 0;
+        session.result.clear();
+        markDirty(r, JOB, RESULT);
+    } else if (job != session.job) {
+        //A queued job behind the current one was cancelled
+        if (type == "finished" && session.pending > 0) {
+            --session.pending;
+            markDirty(r, STATE, STATE);
+        }
+    } else if (type == "progress") {
+        //Progress restarts with every phase and only programming moves the
+        //image, so the column, throughput and ETA follow that phase alone
+        if (event["phase"].toString() != "program") {
+            return;
+        }
+        int percent = event["percent"].toInt();
+        if (session.programStartedMs < 0) {
+            session.programStartedMs = m_clock.elapsed();
+        }
+        session.percent = qMax(session.percent, percent);
+        double elapsed = (m_clock.elapsed() - session.programStartedMs) / 1000.0;
+        if (session.percent > 0 && elapsed > 0) {
+            session.throughput = session.bytes * session.percent / 100.0 / elapsed;
+            session.etaSeconds = elapsed * (100 - session.percent) / session.percent;
+        }
+        markDirty(r, PROGRESS, ETA);
+    } else if (type == "message") {
+        session.phase = event["text"].toString();
+        markDirty(r, PHASE, PHASE);
+    } else if (type == "finished") {
+        bool success = event["success"].toBool();
+        bool cancelled = event["cancelled"].toBool();
+        if (cancelled) {
+            session.state = CANCELLED;
+        } else if (success) {
+            session.state = event["up to date"].toBool() ? UP_TO_DATE : DONE;
+            session.percent = 100;
+        } else {
+            session.state = FAILED;
+        }
+        session.lastFailed = !success && !cancelled;
+        session.etaSeconds = -1;
+        session.result = event.contains("error") ? event["error"].toString() : event["summary"].toString();
+        markDirty(r, STATE, RESULT);
+    }
+}
+
+void SessionModel::clear()
+{
+    beginResetModel();
+    m_sessions.clear();
+    m_rows.clear();
+    m_dirty.clear();
+    m_dirtyFirstColumn = COLUMNS;
+    m_dirtyLastColumn = -1;
+    m_flushTimer.stop();
+    endResetModel();
+}
+
+int SessionModel::row(const QString &station)
+{
+    auto it = m_rows.constFind(station);
+    if (it != m_rows.constEnd()) {
+        return it.value();
+    }
+    //New stations are rare, they are inserted straight away
+    int r = m_sessions.size();
+    beginInsertRows(QModelIndex(), r, r);
+    Session session = {station, 0, 0, IDLE, QString(), 0, 0, -1, 0, -1, 0, false, QString()};
+    m_sessions.append(session);
+    m_dirty.append(false);
+    m_rows.insert(station, r);
+    endInsertRows();
+    return r;
+}
+
+void SessionModel::markDirty(int row, int firstColumn, int lastColumn)
+{
+    m_dirty[row] = true;
+    m_dirtyFirstColumn = qMin(m_dirtyFirstColumn, firstColumn);
+    m_dirtyLastColumn = qMax(m_dirtyLastColumn, lastColumn);
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void SessionModel::flush()
+{
+    //One notification per run of adjacent changed rows, over the columns
+    //that changed anywhere this frame.  With every station busy that is a
+    //single dataChanged however many events came in.
+    int rows = m_dirty.size();
+    int r = 0;
+    while (r < rows) {
+        if (!m_dirty[r]) {
+            ++r;
+            continue;
+        }
+        int first = r;
+        while (r < rows && m_dirty[r]) {
+            m_dirty[r] = false;
+            ++r;
+        }
+        emit dataChanged(index(first, m_dirtyFirstColumn), index(r - 1, m_dirtyLastColumn));
+    }
+    m_dirtyFirstColumn = COLUMNS;
+    m_dirtyLastColumn = -1;
+}
+
+QString SessionModel::stateName(int state)
+{
+    switch (state) {
+    case QUEUED:
+        return "Queued";
+    case RUNNING:
+        return "Running";
+    case DONE:
+        return "Done";
+    case UP_TO_DATE:
+        return "Up to date";
+    case FAILED:
+        return "Failed";
+    case CANCELLED:
+        return "Cancelled";
+    }
+    return "Idle";
+}
+
+QString SessionModel::formatEta(double seconds)
+{
+    int s = (int)(seconds + 0.5);
+    return QString("%1:%2").arg(s / 60).arg(s % 60, 2, 10, QChar('0'));
+}
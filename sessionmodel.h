@@ -0,0 +1,61 @@
+#ifndef SESSIONMODEL_H
+#define SESSIONMODEL_H
+
+#include <QAbstractTableModel>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <QVector>
+
+typedef struct {
+    QString station;        //port, or usb:vid:pid
+    int job;                //current or last job, 0 before the first
+    int pending;            //jobs queued behind it
+    int state;              //SessionModel::IDLE etc.
+    QString phase;          //last message from the bootloader
+    int percent;
+    qint64 bytes;           //image data of the current job
+    qint64 programStartedMs; //-1 until the programming phase starts
+    double throughput;      //bytes per second, 0 until known
+    double etaSeconds;      //-1 until known
+    int retries;            //jobs started after a failed one
+    bool lastFailed;
+    QString result;
+} Session;
+
+//One row per flashing station, fed with the job events of the flashing
+//daemon (see daemon/flashdaemon.h).  Stations report many times a second,
+//so changes are only collected as they come in and go out once per frame
+//as one dataChanged per run of adjacent changed rows.
+class SessionModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum {STATION, JOB, STATE, PHASE, PROGRESS, THROUGHPUT, ETA, RETRIES, RESULT, COLUMNS};
+    enum {IDLE, QUEUED, RUNNING, DONE, UP_TO_DATE, FAILED, CANCELLED};
+    explicit SessionModel(QObject *parent = nullptr);
+    virtual int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    virtual int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    void applyEvent(const QJsonObject &event);
+    void clear();
+private:
+    enum {FRAME_MS = 16};
+    QVector<Session> m_sessions;
+    QHash<QString, int> m_rows;
+    QElapsedTimer m_clock;
+    //Changes not yet announced
+    QVector<bool> m_dirty;
+    int m_dirtyFirstColumn;
+    int m_dirtyLastColumn;
+    QTimer m_flushTimer;
+    int row(const QString &station);
+    void markDirty(int row, int firstColumn, int lastColumn);
+    void flush();
+    static QString stateName(int state);
+    static QString formatEta(double seconds);
+};
+
+#endif // SESSIONMODEL_H
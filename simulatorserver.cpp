@@ -0,0 +1,35 @@
+#include "simulatorserver.h"
+#include "uartsimulator.h"
+#include <QTcpSocket>
+#include <QTimer>
+
+SimulatorServer::SimulatorServer(uint16_t eraseBlockSize, int latencyMs) :
+    QTcpServer(), m_eraseBlockSize(eraseBlockSize), m_latencyMs(latencyMs)
+{
+    connect(this, &QTcpServer::newConnection, this, &SimulatorServer::onNewConnection);
+}
+
+void SimulatorServer::onNewConnection()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        UARTSimulator *target = new UARTSimulator(m_eraseBlockSize);
+        target->setParent(socket);
+        target->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+        int latencyMs = m_latencyMs;
+        connect(socket, &QTcpSocket::readyRead, socket, [socket, target, latencyMs]() {
+            target->write(socket->readAll());
+            QByteArray reply = target->readAll();
+            if (reply.isEmpty()) {
+                return;
+            }
+            if (latencyMs > 0) {
+                //Equal delays keep the replies in order
+                QTimer::singleShot(latencyMs, socket, [socket, reply]() {socket->write(reply);});
+            } else {
+                socket->write(reply);
+            }
+        });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
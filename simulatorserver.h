@@ -0,0 +1,19 @@
+#ifndef SIMULATORSERVER_H
+#define SIMULATORSERVER_H
+
+#include <QTcpServer>
+
+//Serves UARTSimulator targets over TCP, one per connection, as a local
+//stand-in for a ser2net style bridge.  An optional delay on every reply
+//emulates a remote fixture.
+class SimulatorServer : public QTcpServer
+{
+public:
+    SimulatorServer(uint16_t eraseBlockSize, int latencyMs = 0);
+private:
+    uint16_t m_eraseBlockSize;
+    int m_latencyMs;
+    void onNewConnection();
+};
+
+#endif // SIMULATORSERVER_H
@@ -0,0 +1,88 @@
+#include "srecfile.h"
+#include <QFile>
+
+SRecFile::SRecFile()
+{
+
+}
+
+bool SRecFile::loadSRec(QString srecFileName, FirmwareImage &image)
+{
+    QFile srecFile(srecFileName);
+    if (!srecFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    char lineBuffer[524];
+    uint8_t record[256];
+    image.clear();
+    while (srecFile.readLine(lineBuffer, sizeof(lineBuffer)) > 0) {
+        if (lineBuffer[0] != 'S' || lineBuffer[1] < '0' || lineBuffer[1] > '9') {
+            continue;
+        }
+        int count = hexByte(&lineBuffer[2]);
+        if (count < 3) {
+            return false;
+        }
+        uint8_t checksum = count;
+        for (int i = 0; i < count; ++i) {
+            int value = hexByte(&lineBuffer[4 + i * 2]);
+            if (value < 0) {
+                return false;
+            }
+            record[i] = value;
+            checksum += value;
+        }
+        if (checksum != 0xff) {
+            return false;
+        }
+        int addressLength;
+        switch (lineBuffer[1]) {
+        case '1':
+            addressLength = 2;
+            break;
+        case '2':
+            addressLength = 3;
+            break;
+        case '3':
+            addressLength = 4;
+            break;
+        case '7':
+        case '8':
+        case '9':
+            //Termination record
+            return !image.isEmpty();
+        default:
+            //Header and count records carry no data
+            continue;
+        }
+        if (count < addressLength + 1) {
+            return false;
+        }
+        uint32_t address = 0;
+        for (int i = 0; i < addressLength; ++i) {
+            address = (address << 8) | record[i];
+        }
+        image.addData(address, QByteArray((char *)&record[addressLength], count - addressLength - 1));
+    }
+    //No termination record, accept the file if it contained any data
+    return !image.isEmpty();
+}
+
+int SRecFile::hexByte(const char *p)
+{
+    int value = 0;
+    for (int i = 0; i < 2; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value += c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            value += 10 + (c - 'A');
+        } else if (c >= 'a' && c <= 'f') {
+            value += 10 + (c - 'a');
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
@@ -0,0 +1,18 @@
+#ifndef SRECFILE_H
+#define SRECFILE_H
+
+#include <QString>
+#include "firmwareimage.h"
+
+//Streaming Motorola S-record parser.  Lines are decoded one at a time into
+//the image so the whole text file is never held in memory.
+class SRecFile
+{
+public:
+    SRecFile();
+    static bool loadSRec(QString srecFileName, FirmwareImage &image);
+private:
+    static int hexByte(const char *p);
+};
+
+#endif // SRECFILE_H
@@ -0,0 +1,81 @@
+/*
+ * Reference decoder for the BL_CMD_DATA_LZ command.
+ *
+ * This file is plain C99 with no library dependencies so it can be dropped
+ * into the Harmony UART bootloader project.  The host compresses each erase
+ * block page on its own, so a DATA_LZ payload is:
+ *
+ *     uint32_t address;        // same as BL_CMD_DATA
+ *     uint8_t  block[size - 4] // LZ4 block format, decodes to one page
+ *
+ * The target decodes straight into its page buffer and then erases and
+ * programs the page exactly as for BL_CMD_DATA.  The page must decode to
+ * exactly one erase block, otherwise BL_RESP_ERROR is returned.
+ *
+ * The host also sends BL_CMD_READ_CAPS before unlocking.  A target that
+ * supports this decoder answers BL_RESP_OK followed by a little endian
+ * uint32_t with bit 0 (BL_CAP_DATA_LZ) set.
+ */
+
+#include "lz_decode.h"
+
+int lz_decode(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity)
+{
+    const uint8_t *ip = src;
+    const uint8_t *ipEnd = src + srcLen;
+    uint8_t *op = dst;
+    uint8_t *opEnd = dst + dstCapacity;
+
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+        uint32_t length = token >> 4;
+        if (length == 15) {
+            uint8_t s;
+            do {
+                if (ip >= ipEnd) {
+                    return -1;
+                }
+                s = *ip++;
+                length += s;
+            } while (s == 255);
+        }
+        if (length > (uint32_t)(ipEnd - ip) || length > (uint32_t)(opEnd - op)) {
+            return -1;
+        }
+        while (length--) {
+            *op++ = *ip++;
+        }
+        if (ip >= ipEnd) {
+            break;  //last sequence has no match
+        }
+        if (ipEnd - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) {
+            return -1;
+        }
+        length = (token & 0x0f) + 4;
+        if ((token & 0x0f) == 15) {
+            uint8_t s;
+            do {
+                if (ip >= ipEnd) {
+                    return -1;
+                }
+                s = *ip++;
+                length += s;
+            } while (s == 255);
+        }
+        if (length > (uint32_t)(opEnd - op)) {
+            return -1;
+        }
+        {
+            const uint8_t *match = op - offset;
+            while (length--) {
+                *op++ = *match++;  //byte copy handles overlapping matches
+            }
+        }
+    }
+    return (int)(op - dst);
+}
@@ -0,0 +1,21 @@
+#ifndef LZ_DECODE_H
+#define LZ_DECODE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decode one LZ compressed page (LZ4 block format) into dst.
+// The only dictionary is the output already written to dst, so the
+// target needs no RAM beyond its erase block page buffer.
+// Returns the number of bytes written or -1 if the input is malformed
+// or would overflow dst.
+int lz_decode(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LZ_DECODE_H
@@ -0,0 +1,218 @@
+#include "throughputbenchmark.h"
+#include "hidbootloader.h"
+#include "hidsimulator.h"
+#include "uartbootloader.h"
+#include "uartsimulator.h"
+#include "hexfile.h"
+#include "allocationcounter.h"
+#include "realtime.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <ctime>
+
+ThroughputBenchmark::ThroughputBenchmark()
+{
+    m_profiles = {
+        {"usb-fs", true, 64, 1.0, 0},
+        {"usb-hs", true, 1024, 0.125, 0},
+        {"uart-115200", false, 0, 0, 115200},
+        {"uart-921600", false, 0, 0, 921600},
+    };
+    //Fixed images so every run sends the same data
+    BenchmarkImage small = {"small", Bootloader::ARM, 8192, {}};
+    small.segments.insert(0x2000, pattern(16384, 1));
+    BenchmarkImage fragmented = {"fragmented", Bootloader::ARM, 8192, {}};
+    for (int i = 0; i < 200; ++i) {
+        fragmented.segments.insert(0x2000 + i * 1024, pattern(100, i));
+    }
+    BenchmarkImage sparse = {"sparse-pic32", Bootloader::PIC32, 16384, {}};
+    sparse.segments.insert(0x1d000000, pattern(49152, 2));
+    sparse.segments.insert(0x1d080000, pattern(8192, 3));
+    sparse.segments.insert(0x1d0fc000, pattern(4096, 4));
+    BenchmarkImage large = {"large-same7x", Bootloader::ARM, 8192, {}};
+    large.segments.insert(0x402000, pattern(0x100000 - 0x2000, 5));
+    m_images = {small, fragmented, sparse, large};
+}
+
+QByteArray ThroughputBenchmark::pattern(int size, uint32_t seed)
+{
+    //Roughly code-like: every other line repeats an earlier one, so the UART
+    //compression sees a ratio close to a real build
+    QByteArray data(size, 0);
+    uint32_t x = seed * 2654435761u + 1;
+    for (int i = 0; i < size; ++i) {
+        if ((i / 16) % 2 && i >= 32) {
+            data[i] = data[i - 32];
+        } else {
+            x = x * 1103515245 + 12345;
+            data[i] = (char)(x >> 16);
+        }
+    }
+    return data;
+}
+
+QString ThroughputBenchmark::writeHex(const BenchmarkImage &image)
+{
+    QString fileName = m_dir.filePath(image.name + ".hex");
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return QString();
+    }
+    auto writeRecord = [&file](uint8_t type, uint16_t address, const uint8_t *data, uint8_t len) {
+        uint8_t binary[21];
+        int binaryLen = HexRecord::build(binary, type, address, data, len);
+        file.write(":" + QByteArray((const char *)binary, binaryLen).toHex().toUpper() + "\n");
+    };
+    uint32_t upper = 0xffffffff;
+    for (auto it = image.segments.cbegin(); it != image.segments.cend(); ++it) {
+        uint32_t address = it.key();
+        const uint8_t *data = (const uint8_t *)it.value().constData();
+        uint32_t remaining = it.value().size();
+        while (remaining > 0) {
+            if (address >> 16 != upper) {
+                upper = address >> 16;
+                uint8_t linear[2] = {(uint8_t)(upper >> 8), (uint8_t)upper};
+                writeRecord(HexRecord::HEX_LIN_ADDRESS, 0, linear, 2);
+            }
+            uint32_t len = qMin(remaining, 16 - address % 16);
+            writeRecord(HexRecord::HEX_DATA, address & 0xffff, data, len);
+            address += len;
+            data += len;
+            remaining -= len;
+        }
+    }
+    writeRecord(HexRecord::HEX_EOF, 0, nullptr, 0);
+    return fileName;
+}
+
+QList<BenchmarkResult> ThroughputBenchmark::run()
+{
+    QList<BenchmarkResult> results;
+    for (auto &image : m_images) {
+        QString fileName = writeHex(image);
+        for (auto &profile : m_profiles) {
+            if (fileName.isEmpty()) {
+                results.append({profile.name + "/" + image.name, false, 0, 0, 0, 0});
+                continue;
+            }
+            results.append(runJob(profile, image, fileName));
+        }
+    }
+    return results;
+}
+
+BenchmarkResult ThroughputBenchmark::runJob(const BenchmarkProfile &profile, const BenchmarkImage &image,
+                                            QString fileName)
+{
+    BenchmarkResult result = {profile.name + "/" + image.name, false, 0, 0, 0, 0, 0};
+    qint64 violations = AllocationCounter::violations();
+    std::clock_t cpuStart = std::clock();
+    QElapsedTimer wall;
+    wall.start();
+    std::unique_ptr<Bootloader> bootloader;
+    HidSimulator *hid = nullptr;
+    UARTSimulator *uart = nullptr;
+    if (profile.usb) {
+        hid = new HidSimulator(profile.reportSize);
+        bootloader.reset(new HidBootloader(hid));
+    } else {
+        //Owned by the bootloader once set as its transport
+        uart = new UARTSimulator(image.eraseBlockSize);
+        UARTBootloader *uartBootloader = new UARTBootloader("Benchmark", profile.baud,
+                                                            image.segments.firstKey(), image.eraseBlockSize);
+        uartBootloader->setTransport(uart);
+        bootloader.reset(uartBootloader);
+    }
+    bootloader->setFamily(image.family);
+    //Same sequence as WorkerThread without its settings side effects
+    result.success = bootloader->setFile(fileName) && bootloader->eraseFlash()
+            && bootloader->programFlash() && bootloader->verify();
+    if (result.success) {
+        bootloader->jumpToApp();
+    }
+    result.wallMs = wall.nsecsElapsed() / 1e6;
+    result.cpuMs = 1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    result.loopAllocations = AllocationCounter::violations() - violations;
+    if (hid) {
+        qint64 reports = hid->reportsOut() + hid->reportsIn();
+        result.wireBytes = reports * profile.reportSize;
+        result.linkMs = reports * profile.reportIntervalMs;
+    } else {
+        qint64 bytes = uart->bytesReceived() + uart->bytesSent();
+        result.wireBytes = bytes;
+        result.linkMs = bytes * 10000.0 / profile.baud;   //8N1
+    }
+    return result;
+}
+
+QJsonObject ThroughputBenchmark::toJson(const QList<BenchmarkResult> &results)
+{
+    QJsonObject json;
+    for (auto &i : results) {
+        json[i.name] = QJsonObject{{"success", i.success}, {"wall ms", i.wallMs}, {"cpu ms", i.cpuMs},
+                                   {"wire bytes", i.wireBytes}, {"link ms", i.linkMs},
+                                   {"loop allocations", i.loopAllocations}};
+    }
+    return json;
+}
+
+QString ThroughputBenchmark::table(const QList<BenchmarkResult> &results)
+{
+    QStringList lines;
+    lines.append(QString("%1 %2 %3 %4 %5 %6").arg("job", -28).arg("wall ms", 10).arg("cpu ms", 10)
+                 .arg("wire bytes", 12).arg("link ms", 12).arg("loop allocs", 12));
+    for (auto &i : results) {
+        lines.append(QString("%1 %2 %3 %4 %5 %6%7").arg(i.name, -28).arg(i.wallMs, 10, 'f', 1)
+                     .arg(i.cpuMs, 10, 'f', 1).arg(i.wireBytes, 12).arg(i.linkMs, 12, 'f', 1)
+                     .arg(AllocationCounter::enabled() ? QString::number(i.loopAllocations) : "-", 12)
+                     .arg(i.success ? "" : "  FAILED"));
+    }
+    if (AllocationCounter::enabled() && !AllocationCounter::coversMalloc()) {
+        lines.append("loop allocs only counts operator new with this toolchain, malloc is not seen");
+    }
+    return lines.join("\n");
+}
+
+QString ThroughputBenchmark::wakeupReport(int core)
+{
+    //Not compared with the baseline, it depends on the host's load
+    WakeupLatency normal = RealtimeScope::measureWakeup();
+    RealtimeScope scope(core);
+    WakeupLatency realtime = RealtimeScope::measureWakeup();
+    return QString("wakeup p50/p99 %1/%2 us, real-time %3/%4 us (%5)")
+            .arg(normal.p50Us).arg(normal.p99Us).arg(realtime.p50Us).arg(realtime.p99Us)
+            .arg(scope.description());
+}
+
+QStringList ThroughputBenchmark::regressions(const QList<BenchmarkResult> &results, const QJsonObject &baseline,
+                                             double threshold)
+{
+    QStringList regressions;
+    for (auto &i : results) {
+        if (!i.success) {
+            regressions.append(i.name + " failed");
+            continue;
+        }
+        //Not against the baseline, the transfer loops must not allocate at all
+        if (i.loopAllocations > 0) {
+            regressions.append(QString("%1 made %2 heap allocations in the transfer loops")
+                               .arg(i.name).arg(i.loopAllocations));
+        }
+        QJsonObject base = baseline[i.name].toObject();
+        if (base.isEmpty()) {
+            continue;
+        }
+        //Wire bytes and link time are deterministic, host times get a noise floor
+        QList<QPair<QString, double>> metrics = {{"wall ms", i.wallMs}, {"cpu ms", i.cpuMs},
+                                                 {"wire bytes", (double)i.wireBytes}, {"link ms", i.linkMs}};
+        for (auto &metric : metrics) {
+            double before = base[metric.first].toDouble();
+            double floor = metric.first.endsWith(" ms") && metric.first != "link ms" ? NOISE_FLOOR_MS : 0;
+            if (metric.second > before * (1 + threshold) && metric.second - before > floor) {
+                regressions.append(QString("%1 %2 %3 -> %4").arg(i.name, metric.first)
+                                   .arg(before, 0, 'f', 1).arg(metric.second, 0, 'f', 1));
+            }
+        }
+    }
+    return regressions;
+}
@@ -0,0 +1,61 @@
+#ifndef THROUGHPUTBENCHMARK_H
+#define THROUGHPUTBENCHMARK_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QStringList>
+#include <QTemporaryDir>
+
+typedef struct {
+    QString name;
+    bool usb;
+    int reportSize;             //USB report payload
+    double reportIntervalMs;    //USB polling interval, one report per interval
+    int baud;                   //UART
+} BenchmarkProfile;
+
+typedef struct {
+    QString name;
+    int family;
+    uint16_t eraseBlockSize;
+    QMap<uint32_t, QByteArray> segments;
+} BenchmarkImage;
+
+typedef struct {
+    QString name;           //profile/image
+    bool success;
+    double wallMs;
+    double cpuMs;
+    qint64 wireBytes;
+    double linkMs;          //modelled time on the wire
+    qint64 loopAllocations; //inside the transfer loops, debug builds only
+} BenchmarkResult;
+
+//Complete erase, program, verify and jump jobs for every link profile and
+//test image against the in-process simulated targets.  Results can be saved
+//as a baseline and later runs compared against it, so a change that makes
+//flashing slower or chattier is caught before release.
+class ThroughputBenchmark
+{
+public:
+    ThroughputBenchmark();
+    QList<BenchmarkResult> run();
+    static QJsonObject toJson(const QList<BenchmarkResult> &results);
+    static QString table(const QList<BenchmarkResult> &results);
+    //Wakeup latency of the calling thread with and without RealtimeScope
+    static QString wakeupReport(int core);
+    //One line per result or metric that is worse than baseline by more than threshold
+    static QStringList regressions(const QList<BenchmarkResult> &results, const QJsonObject &baseline,
+                                   double threshold);
+private:
+    enum {NOISE_FLOOR_MS = 5};  //time differences below this are not regressions
+    QTemporaryDir m_dir;
+    QList<BenchmarkProfile> m_profiles;
+    QList<BenchmarkImage> m_images;
+    static QByteArray pattern(int size, uint32_t seed);
+    QString writeHex(const BenchmarkImage &image);
+    BenchmarkResult runJob(const BenchmarkProfile &profile, const BenchmarkImage &image, QString fileName);
+};
+
+#endif // THROUGHPUTBENCHMARK_H
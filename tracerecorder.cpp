@@ -0,0 +1,133 @@
+#include "tracerecorder.h"
+#include <QJsonDocument>
+
+const char TraceRecorder::MAGIC[8] = {'H', 'B', 'T', 'R', 'A', 'C', 'E', '2'};
+
+TraceRecorder::TraceRecorder(uint32_t ringSize) : QThread(),
+    m_ring(new char[ringSize]), m_ringMask(ringSize - 1),
+    m_head(0), m_tail(0), m_dropped(0), m_stop(false)
+{
+    //ringSize must be a power of two
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    close();
+}
+
+bool TraceRecorder::open(QString fileName, const QJsonObject &meta)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    QByteArray metaJson = QJsonDocument(meta).toJson(QJsonDocument::Compact);
+    uint32_t metaLen = metaJson.size();
+    m_file.write(MAGIC, sizeof(MAGIC));
+    m_file.write((const char *)&metaLen, 4);
+    m_file.write(metaJson);
+    m_head = 0;
+    m_tail = 0;
+    m_dropped = 0;
+    m_stop = false;
+    m_clock.start();
+    QThread::start(QThread::LowPriority);
+    return true;
+}
+
+void TraceRecorder::close()
+{
+    if (isRunning()) {
+        m_stop = true;
+        wait();
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+void TraceRecorder::record(uint8_t direction, const uint8_t *data, uint32_t len)
+{
+    //Called from the transfer thread only
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    uint32_t needed = sizeof(FrameHeader) + len;
+    if ((m_ringMask + 1) - (head - tail) < needed) {
+        ++m_dropped;
+        return;
+    }
+    FrameHeader header = {(uint64_t)m_clock.nsecsElapsed(), len, direction};
+    copyIn(head, (const char *)&header, sizeof(header));
+    copyIn(head + sizeof(header), (const char *)data, len);
+    m_head.store(head + needed, std::memory_order_release);
+}
+
+void TraceRecorder::run()
+{
+    while (!m_stop) {
+        msleep(FLUSH_INTERVAL_MS);
+        drain();
+    }
+    drain();
+    m_file.flush();
+}
+
+void TraceRecorder::copyIn(uint64_t pos, const char *data, uint32_t len)
+{
+    uint32_t offset = pos & m_ringMask;
+    uint32_t first = qMin(len, m_ringMask + 1 - offset);
+    memcpy(&m_ring[offset], data, first);
+    memcpy(&m_ring[0], data + first, len - first);
+}
+
+void TraceRecorder::drain()
+{
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    while (tail != head) {
+        uint32_t offset = tail & m_ringMask;
+        uint32_t len = qMin((uint64_t)(m_ringMask + 1 - offset), head - tail);
+        m_file.write(&m_ring[offset], len);
+        tail += len;
+    }
+    m_tail.store(tail, std::memory_order_release);
+}
+
+bool TraceRecorder::load(QString fileName, QJsonObject &meta, QList<TraceFrame> &frames)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    uint32_t metaLen = 0;
+    if (file.read(magic, sizeof(magic)) != sizeof(magic)
+            || memcmp(magic, MAGIC, sizeof(MAGIC) - 1) != 0
+            || file.read((char *)&metaLen, 4) != 4) {
+        return false;
+    }
+    bool v1 = magic[sizeof(MAGIC) - 1] == '1';
+    if (!v1 && magic[sizeof(MAGIC) - 1] != MAGIC[sizeof(MAGIC) - 1]) {
+        return false;
+    }
+    meta = QJsonDocument::fromJson(file.read(metaLen)).object();
+    frames.clear();
+    for (;;) {
+        FrameHeader header;
+        if (v1) {
+            FrameHeaderV1 old;
+            if (file.read((char *)&old, sizeof(old)) != sizeof(old)) {
+                break;
+            }
+            header = {old.timestamp, old.length, old.direction};
+        } else if (file.read((char *)&header, sizeof(header)) != sizeof(header)) {
+            break;
+        }
+        TraceFrame frame = {header.timestamp, header.direction, file.read(header.length)};
+        if ((uint32_t)frame.data.size() != header.length) {
+            break;
+        }
+        frames.append(frame);
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QThread>
+#include <QFile>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <atomic>
+#include <memory>
+
+typedef struct {
+    uint64_t timestamp;     //ns since the start of the trace
+    uint8_t direction;
+    QByteArray data;
+} TraceFrame;
+
+//Records every frame crossing the transport boundary.  record() only copies
+//into a preallocated ring buffer; the thread drains the ring to disk so the
+//transfer loop never waits on file I/O.  Frames are dropped (and counted)
+//rather than blocking if the writer falls behind.
+class TraceRecorder : public QThread
+{
+public:
+    TraceRecorder(uint32_t ringSize = 1 << 22);
+    ~TraceRecorder();
+    enum {TX = 0, RX = 1};
+    bool open(QString fileName, const QJsonObject &meta);
+    void close();
+    void record(uint8_t direction, const uint8_t *data, uint32_t len);
+    uint32_t droppedFrames() const {return m_dropped;}
+    QString fileName() const {return m_file.fileName();}
+    static bool load(QString fileName, QJsonObject &meta, QList<TraceFrame> &frames);
+protected:
+    virtual void run() override;
+private:
+    //UART DATA payloads (erase block plus address) can pass 64K
+    typedef struct __attribute__ ((packed)) {
+        uint64_t timestamp;
+        uint32_t length;
+        uint8_t direction;
+    } FrameHeader;
+    //Version 1 traces, still loaded for replay
+    typedef struct __attribute__ ((packed)) {
+        uint64_t timestamp;
+        uint16_t length;
+        uint8_t direction;
+    } FrameHeaderV1;
+    static const char MAGIC[8];
+    enum {FLUSH_INTERVAL_MS = 20};
+    std::unique_ptr<char[]> m_ring;
+    uint32_t m_ringMask;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint32_t> m_dropped;
+    std::atomic<bool> m_stop;
+    QElapsedTimer m_clock;
+    QFile m_file;
+    void copyIn(uint64_t pos, const char *data, uint32_t len);
+    void drain();
+};
+
+#endif // TRACERECORDER_H
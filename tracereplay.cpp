@@ -0,0 +1,125 @@
+#include "tracereplay.h"
+#include <QThread>
+
+TraceReplay::TraceReplay(const QList<TraceFrame> &frames) :
+    m_frames(frames), m_pos(0), m_mismatches(0), m_lastTxTimestamp(0), m_lastTxTime(0)
+{
+    m_clock.start();
+}
+
+void TraceReplay::transmit(const uint8_t *data, int len)
+{
+    //Skip responses the host never read in this run
+    while (m_pos < m_frames.size() && m_frames[m_pos].direction != TraceRecorder::TX) {
+        ++m_pos;
+        ++m_mismatches;
+    }
+    if (m_pos >= m_frames.size()) {
+        ++m_mismatches;
+        return;
+    }
+    const TraceFrame &frame = m_frames[m_pos++];
+    int compareLen = qMin(len, (int)frame.data.size());
+    if (len != frame.data.size() || memcmp(data, frame.data.constData(), compareLen) != 0) {
+        ++m_mismatches;
+    }
+    m_lastTxTimestamp = frame.timestamp;
+    m_lastTxTime = m_clock.nsecsElapsed();
+}
+
+static bool replayWait(qint64 usecs, CancelToken *cancel)
+{
+    if (cancel) {
+        return cancel->sleep((usecs + 999) / 1000);
+    }
+    QThread::usleep(usecs);
+    return true;
+}
+
+bool TraceReplay::receive(int wait_ms, QByteArray &data, CancelToken *cancel)
+{
+    if (m_pos >= m_frames.size() || m_frames[m_pos].direction != TraceRecorder::RX) {
+        //Device did not answer when recorded, so time out the same way
+        replayWait((qint64)wait_ms * 1000, cancel);
+        return false;
+    }
+    const TraceFrame &frame = m_frames[m_pos];
+    qint64 due = m_lastTxTime + (qint64)(frame.timestamp - m_lastTxTimestamp);
+    qint64 wait = due - m_clock.nsecsElapsed();
+    if (wait > (qint64)wait_ms * 1000000) {
+        replayWait((qint64)wait_ms * 1000, cancel);
+        return false;
+    }
+    if (wait > 0 && !replayWait(wait / 1000, cancel)) {
+        return false;
+    }
+    data = frame.data;
+    ++m_pos;
+    return true;
+}
+
+TraceReplayLink::TraceReplayLink(const QList<TraceFrame> &frames, int inputReportSize, int outputReportSize) :
+    m_replay(frames), m_inputReportSize(inputReportSize), m_outputReportSize(outputReportSize)
+{
+
+}
+
+bool TraceReplayLink::WriteDevice(uint8_t *buffer, int len, int wait_ms)
+{
+    (void) wait_ms;
+    m_replay.transmit(buffer, len);
+    return true;
+}
+
+bool TraceReplayLink::ReadDevice(uint8_t *buffer, int wait_ms)
+{
+    QByteArray data;
+    if (!m_replay.receive(wait_ms, data, m_cancel)) {
+        return false;
+    }
+    memcpy(buffer, data.constData(), qMin((int)data.size(), m_inputReportSize));
+    return true;
+}
+
+TraceReplayDevice::TraceReplayDevice(const QList<TraceFrame> &frames) : QIODevice(), m_replay(frames)
+{
+
+}
+
+qint64 TraceReplayDevice::bytesAvailable() const
+{
+    return m_rxBuffer.size() + QIODevice::bytesAvailable();
+}
+
+bool TraceReplayDevice::waitForReadyRead(int msecs)
+{
+    if (!m_rxBuffer.isEmpty()) {
+        return true;
+    }
+    QByteArray data;
+    if (!m_replay.receive(msecs, data)) {
+        return false;
+    }
+    m_rxBuffer.append(data);
+    return true;
+}
+
+bool TraceReplayDevice::waitForBytesWritten(int msecs)
+{
+    (void) msecs;
+    return true;
+}
+
+qint64 TraceReplayDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 len = qMin(maxSize, (qint64)m_rxBuffer.size());
+    memcpy(data, m_rxBuffer.constData(), len);
+    m_rxBuffer.remove(0, len);
+    return len;
+}
+
+qint64 TraceReplayDevice::writeData(const char *data, qint64 maxSize)
+{
+    m_replay.transmit((const uint8_t *)data, maxSize);
+    return maxSize;
+}
@@ -0,0 +1,64 @@
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include <QIODevice>
+#include <QElapsedTimer>
+#include "hidlink.h"
+#include "tracerecorder.h"
+#include "canceltoken.h"
+
+//Plays back the device side of a recorded trace.  Each response is held back
+//by the delay it had after the preceding request when it was recorded, so the
+//host side runs with the original device timing.
+class TraceReplay
+{
+public:
+    TraceReplay(const QList<TraceFrame> &frames);
+    void transmit(const uint8_t *data, int len);
+    bool receive(int wait_ms, QByteArray &data, CancelToken *cancel = nullptr);
+    int mismatches() const {return m_mismatches;}
+private:
+    QList<TraceFrame> m_frames;
+    int m_pos;
+    int m_mismatches;
+    uint64_t m_lastTxTimestamp;
+    qint64 m_lastTxTime;
+    QElapsedTimer m_clock;
+};
+
+class TraceReplayLink : public HidLink
+{
+public:
+    TraceReplayLink(const QList<TraceFrame> &frames, int inputReportSize = DEFAULT_REPORT_SIZE,
+                    int outputReportSize = DEFAULT_REPORT_SIZE);
+    virtual bool WriteDevice(uint8_t *buffer, int len, int wait_ms = 200) override;
+    virtual bool ReadDevice(uint8_t *buffer, int wait_ms = 200) override;
+    virtual bool Connected(void) override {return true;}
+    virtual void Close(void) override {}
+    virtual int inputReportSize(void) override {return m_inputReportSize;}
+    virtual int outputReportSize(void) override {return m_outputReportSize;}
+    int mismatches() const {return m_replay.mismatches();}
+private:
+    TraceReplay m_replay;
+    int m_inputReportSize;
+    int m_outputReportSize;
+};
+
+class TraceReplayDevice : public QIODevice
+{
+public:
+    TraceReplayDevice(const QList<TraceFrame> &frames);
+    virtual bool isSequential() const override {return true;}
+    virtual qint64 bytesAvailable() const override;
+    virtual bool waitForReadyRead(int msecs) override;
+    virtual bool waitForBytesWritten(int msecs) override;
+    int mismatches() const {return m_replay.mismatches();}
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize) override;
+    virtual qint64 writeData(const char *data, qint64 maxSize) override;
+private:
+    TraceReplay m_replay;
+    QByteArray m_rxBuffer;
+};
+
+#endif // TRACEREPLAY_H
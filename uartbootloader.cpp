@@ -1,11 +1,25 @@
 #include "uartbootloader.h"
-#include "hexfile.h"
+#include "uartsimulator.h"
+#include "lzblock.h"
+#include "allocationcounter.h"
+#include <QTcpSocket>
+#include <QUrl>
+#ifdef Q_OS_LINUX
+#include "posixserialport.h"
+#endif
+#include <algorithm>
+
+QHash<QString, UARTBootloader::Checkpoint> UARTBootloader::s_checkpoints;
+QMutex UARTBootloader::s_checkpointMutex;
 
 UARTBootloader::UARTBootloader(QString portName, int baud, uint32_t startAddress, uint16_t eraseBlockSize) :
     Bootloader(), m_portName(portName), m_baud(baud)
   , m_connected(false), m_flashStart(startAddress), m_eraseBlockSize(eraseBlockSize)
+  , m_compressionEnabled(true), m_lzSupported(false), m_pipelineSupported(false), m_nativeSerial(false)
+  , m_keepOpen(false), m_commandRttMs(0), m_sendHead(0), m_sendCount(0)
 {
     m_txHeader.guard = BTL_GUARD;
+    m_linkClock.start();
     if (m_portName != "") {
         m_connected = true;
     }
@@ -20,19 +34,7 @@ bool UARTBootloader::isConnected()
 
 bool UARTBootloader::setFile(QString fileName)
 {
-    if (fileName.endsWith(".hex", Qt::CaseInsensitive)) {
-        m_binFile = HexFile::hexToBinFile(fileName, m_flashStart);
-        if (m_binFile) {
-            return m_binFile->open(QIODevice::ReadOnly);
-        } else {
-            return false;
-        }
-    } else if (fileName.endsWith(".bin", Qt::CaseInsensitive)) {
-        m_binFile.reset(new QFile());
-        m_binFile->setFileName(fileName);
-        return m_binFile->open(QIODevice::ReadOnly);
-    }
-    return false;
+    return loadPagedImage(fileName, m_flashStart, m_eraseBlockSize, m_flashData);
 }
 
 bool UARTBootloader::programFlash()
@@ -40,110 +42,154 @@ bool UARTBootloader::programFlash()
     uint32_t flashLen = 0;
     int blocks = 0;
     int currentBlock = 0;
-    uint32_t data[m_eraseBlockSize / 4 + 1];  //extra word for address
-    int bytesRead;
+    int compressedBlocks = 0;
 
     emit message("Programming flash");
-    m_flashCRC = generateCRC(flashLen);
+    m_flashCRC = generateCRC();
+    flashLen = m_flashData.size();
     blocks = flashLen / m_eraseBlockSize;
-    m_port.reset(new QSerialPort(nullptr));
-    m_port->setPortName(m_portName);
-    m_port->setBaudRate(m_baud);
-    m_port->setDataBits(QSerialPort::Data8);
-    m_port->setParity(QSerialPort::NoParity);
-    m_port->setStopBits(QSerialPort::OneStop);
-    m_connected = m_port->open(QIODevice::ReadWrite);
-    if (!m_connected) {
-        emit finished(false);
-        return false;
+    m_roundTrips.clear();
+    m_sendHead = 0;
+    m_sendCount = 0;
+    if (!isPortOpen()) {
+        m_connected = openPort();
+        if (!m_connected) {
+            emit finished(false);
+            return false;
+        }
     }
+    //Every job, the round trip it measures sizes the pipeline window
+    queryCapabilities();
+    int commandSamples = m_roundTrips.size();
+    //One sample for UNLOCK and each block, taken inside the loop
+    m_roundTrips.reserve(commandSamples + blocks + 1);
     char result;
-    m_txHeader.size = 8;
-    m_txHeader.command = BL_CMD_UNLOCK;
-    m_port->write(m_txHeader.bytes, 9);
-    m_port->flush();
     uint32_t unlock[2] = {m_flashStart, flashLen};
-    m_port->write((char *)&unlock[0], 8);
-    m_port->flush();
-    m_port->waitForReadyRead(1000);
-    if (m_port->bytesAvailable() < 1) {
+    send<Unlock>(unlock);
+    if (!readResponse(&result, 1) || result != BL_RESP_OK) {
         emit finished(false);
         return false;
     }
-    m_port->read(&result, 1);
-    if (result != BL_RESP_OK) {
-        emit finished(false);
-        return false;
+    //UNLOCK does not erase, every DATA block erases its own page, so an
+    //interrupted session can carry on from the last acknowledged block.
+    currentBlock = resumeBlock();
+    if (currentBlock > 0) {
+        emit message(QString("Resuming at block %1 of %2").arg(currentBlock + 1).arg(blocks));
+    }
+    //Creates the entry, the loop then only updates it
+    saveCheckpoint(currentBlock);
+    //Targets that buffer whole commands can take the next blocks while they
+    //program the current one.  Keep enough in flight to cover the network
+    //round trip, measured by the command RTT against the spacing of the acks.
+    int window = 1;
+    int maxWindow = 1;
+    if (m_pipelineSupported && isNetwork()) {
+        maxWindow = qBound(1, (int)(SOCKET_BUFFER / (m_eraseBlockSize + sizeof(TxHeader) + 4)), (int)MAX_WINDOW);
     }
-    m_binFile->reset();
-    uint32_t currentAddress = m_flashStart;
+    qint64 baseRtt = commandSamples > 0 ? *std::min_element(m_roundTrips.begin(),
+                                                            m_roundTrips.begin() + commandSamples) : 0;
+    qint64 ackInterval = 0;
+    qint64 lastAck = -1;
+    int maxUsedWindow = 1;
+    int sentBlock = currentBlock;
+    int percent = -1;
+    NoAllocationScope steady("UART program loop");
     while (currentBlock < blocks) {
-        if (m_abort) {
+        if (m_cancel.isCancelled()) {
             emit finished(false);
             return false;
         }
-        data[0] = currentAddress;
-        bytesRead = m_binFile->read((char *)&data[1], m_eraseBlockSize);
-        if (bytesRead < m_eraseBlockSize) {
-            memset((char *)&data[1] + bytesRead, 0xff, m_eraseBlockSize - bytesRead);
+        while (sentBlock < blocks && sentBlock - currentBlock < window) {
+            if (sendBlock(sentBlock)) {
+                ++compressedBlocks;
+            }
+            ++sentBlock;
         }
-        m_txHeader.size = m_eraseBlockSize + 4;
-        m_txHeader.command = BL_CMD_DATA;
-        m_port->write(m_txHeader.bytes, 9);
-        m_port->flush();
-        m_port->write((char *)data, sizeof(data));
-        m_port->flush();
-        m_port->waitForReadyRead(1000);
-        if (m_port->bytesAvailable() < 1) {
+        if (!readResponse(&result, 1) || result != BL_RESP_OK) {
+            if (m_cancel.isCancelled()) {
+                //Let the block in flight go out whole so the target is not
+                //left part way through a command.  It is sent again on resume.
+                m_port->waitForBytesWritten(1000);
+                emit message(QString("Cancelled, resume continues at block %1").arg(currentBlock + 1));
+            }
             emit finished(false);
             return false;
         }
-        m_port->read(&result, 1);
-        if (result != BL_RESP_OK) {
-            emit finished(false);
-            return false;
+        if (maxWindow > 1) {
+            qint64 now = m_linkClock.nsecsElapsed();
+            if (lastAck >= 0) {
+                //Acks read from the same buffer can share a timestamp
+                ackInterval = qMax<qint64>(1, ackInterval ? (7 * ackInterval + (now - lastAck)) / 8 : now - lastAck);
+                window = qBound(1, 1 + (int)((baseRtt + ackInterval - 1) / ackInterval), maxWindow);
+                maxUsedWindow = qMax(maxUsedWindow, window);
+            }
+            lastAck = now;
         }
         ++currentBlock;
-        currentAddress += m_eraseBlockSize;
-        emit progress(currentBlock * 100 / blocks);
+        saveCheckpoint(currentBlock);
+        updateProgress(percent, currentBlock * 100 / blocks);
+    }
+    steady.end();
+    if (m_lzSupported) {
+        emit message(QString("%1 of %2 blocks sent compressed").arg(compressedBlocks).arg(blocks));
+    }
+    if (commandSamples > 0) {
+        m_commandRttMs = medianMs(m_roundTrips.mid(0, commandSamples));
+        emit message(QString("Round trip %1 ms per command, %2 ms per block%3")
+                     .arg(m_commandRttMs, 0, 'f', 2)
+                     .arg(medianMs(m_roundTrips.mid(commandSamples)), 0, 'f', 2)
+                     .arg(maxUsedWindow > 1 ? QString(", up to %1 blocks in flight").arg(maxUsedWindow) : ""));
     }
-    m_binFile->close();
     return true;
 }
 
+bool UARTBootloader::sendBlock(int block)
+{
+    //Returns true if the block went out compressed
+    uint32_t *data = m_blockData;
+    uint32_t *packed = m_blockPacked;
+    uint32_t address = m_flashStart + block * m_eraseBlockSize;
+    data[0] = address;
+    memcpy(&data[1], m_flashData.constData() + block * m_eraseBlockSize, m_eraseBlockSize);
+    int packedLen = 0;
+    if (m_lzSupported) {
+        //Only worth sending compressed if it saves at least one byte
+        packedLen = LZBlock::compress((uint8_t *)&data[1], m_eraseBlockSize,
+                                      (uint8_t *)&packed[1], m_eraseBlockSize - 1);
+    }
+    if (packedLen > 0) {
+        packed[0] = address;
+        sendCommand(BL_CMD_DATA_LZ, (char *)packed, packedLen + 4);
+        return true;
+    }
+    sendCommand(BL_CMD_DATA, (char *)data, m_eraseBlockSize + 4);
+    return false;
+}
+
 void UARTBootloader::jumpToApp()
 {
-    m_txHeader.size = 1;
-    m_txHeader.command = BL_CMD_RESET;
-    m_port->write(m_txHeader.bytes, 9);
-    m_port->flush();
-    m_port->write(m_txHeader.bytes, 1);  //need a dummy byte
-    m_port->flush();
+    uint8_t dummy = 0;
+    send<Reset>(dummy);
     char result = 0;
-    m_port->waitForReadyRead(1000);
-    if (m_port->bytesAvailable() < 1) {
+    if (!readResponse(&result, 1)) {
         emit finished(false);
         return;
     }
-    m_port->read(&result, 1);
-    m_port->close();
+    if (!m_keepOpen) {
+        m_port->close();
+    }
     emit finished(true);
 }
 
 bool UARTBootloader::verify()
 {
-    m_txHeader.size = 4;
-    m_txHeader.command = BL_CMD_VERIFY;
-    m_port->write(m_txHeader.bytes, 9);
-    m_port->flush();
-    m_port->write((char *)&m_flashCRC, 4);
-    m_port->flush();
+    send<Verify>(m_flashCRC);
     char result = 0;
-    m_port->waitForReadyRead(1000);
-    if (m_port->bytesAvailable() < 1) {
+    if (!readResponse(&result, 1)) {
         return false;
     }
-    m_port->read(&result, 1);
+    //Whole range was checked, a retry after this starts over either way
+    clearCheckpoint();
     if (result != BL_RESP_CRC_OK) {
         emit message("Flash verify failed");
         return false;
@@ -152,43 +198,200 @@ bool UARTBootloader::verify()
     return true;
 }
 
-uint32_t UARTBootloader::generateCRC(uint32_t &flashLen)
-{
-    uint32_t   value;
-    uint32_t   crc_tab[256];
-    uint32_t   crc = 0xffffffff;
-    uint8_t    data[m_eraseBlockSize];
-    int bytesRead;
-    flashLen = 0;
-    for (int i = 0; i < 256; i++)
-    {
-        value = i;
-        for (int j = 0; j < 8; j++)
-        {
-            if (value & 1)
-            {
-                value = (value >> 1) ^ 0xEDB88320;
-            }
-            else
-            {
-                value >>= 1;
-            }
+bool UARTBootloader::isPortOpen() const
+{
+    //A bridge that dropped the connection is opened again
+    QAbstractSocket *socket = qobject_cast<QAbstractSocket *>(m_port.get());
+    return m_port && m_port->isOpen() && !m_transport
+            && (!socket || socket->state() == QAbstractSocket::ConnectedState);
+}
+
+bool UARTBootloader::openPort()
+{
+    if (m_transport) {
+        //Replay or other injected transport, used once
+        m_port = std::move(m_transport);
+        return m_port->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    }
+    if (m_portName == UARTSimulator::portName()) {
+        m_port.reset(new UARTSimulator(m_eraseBlockSize));
+        return m_port->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    }
+    if (isNetwork()) {
+        //Raw TCP to a serial bridge such as ser2net, tcp://host:port
+        QUrl url(m_portName);
+        QTcpSocket *socket = new QTcpSocket();
+        m_port.reset(socket);
+        socket->connectToHost(url.host(), url.port());
+        if (!socket->waitForConnected(TCP_CONNECT_TIMEOUT)) {
+            emit message(QString("Unable to connect to %1: %2").arg(m_portName, socket->errorString()));
+            return false;
         }
-        crc_tab[i] = value;
+        //Commands are sent whole, Nagle would only hold the last segment back
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, SOCKET_BUFFER);
+        return true;
     }
-    m_binFile->reset();
-    do {
-        bytesRead = m_binFile->read((char *)data, m_eraseBlockSize);
-        if (bytesRead > 0) {
-            flashLen += m_eraseBlockSize;
+#ifdef Q_OS_LINUX
+    if (m_nativeSerial) {
+        PosixSerialPort *native = new PosixSerialPort(m_portName, m_baud);
+        m_port.reset(native);
+        if (native->open(QIODevice::ReadWrite)) {
+            return true;
         }
-        for (int i = 0; i < m_eraseBlockSize; ++i) {
-            if (i >= bytesRead) {
-                data[i] = 0xff;
-            }
-            crc = crc_tab[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        emit message(native->errorString() + ", using QSerialPort");
+    }
+#endif
+    QSerialPort *port = new QSerialPort(nullptr);
+    m_port.reset(port);
+    port->setPortName(m_portName);
+    port->setBaudRate(m_baud);
+    port->setDataBits(QSerialPort::Data8);
+    port->setParity(QSerialPort::NoParity);
+    port->setStopBits(QSerialPort::OneStop);
+    if (!port->open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    //Drop any reply left over from a cancelled session
+    port->clear();
+    return true;
+}
+
+void UARTBootloader::flushPort()
+{
+    QSerialPort *port = qobject_cast<QSerialPort *>(m_port.get());
+    QAbstractSocket *socket = qobject_cast<QAbstractSocket *>(m_port.get());
+    if (port) {
+        port->flush();
+    } else if (socket) {
+        socket->flush();
+    } else {
+        m_port->waitForBytesWritten(0);
+    }
+}
+
+void UARTBootloader::sendCommand(uint8_t command, const char *payload, uint32_t size)
+{
+    if (m_cancel.isCancelled()) {
+        return;
+    }
+    m_txHeader.size = size;
+    m_txHeader.command = command;
+    m_port->write(m_txHeader.bytes, 9);
+    //Over TCP the header goes out in the same segment as the payload
+    if (!isNetwork()) {
+        flushPort();
+    }
+    m_port->write(payload, size);
+    flushPort();
+    if (m_sendCount == SEND_TIMES) {
+        //Replies went missing, drop the oldest
+        m_sendHead = (m_sendHead + 1) % SEND_TIMES;
+        --m_sendCount;
+    }
+    m_sendTimes[(m_sendHead + m_sendCount++) % SEND_TIMES] = m_linkClock.nsecsElapsed();
+    if (m_trace) {
+        m_trace->record(TraceRecorder::TX, (const uint8_t *)m_txHeader.bytes, 9);
+        m_trace->record(TraceRecorder::TX, (const uint8_t *)payload, size);
+    }
+}
+
+bool UARTBootloader::readResponse(char *response, int len, int wait_ms)
+{
+    //Serial ports have no handle to wake them, so wait in short slices
+    //and check for cancel in between
+    QElapsedTimer timer;
+    timer.start();
+    while (m_port->bytesAvailable() < len && !m_cancel.isCancelled()) {
+        int remaining = wait_ms - timer.elapsed();
+        if (remaining <= 0) {
+            break;
         }
-    } while (bytesRead == m_eraseBlockSize);
-    return crc;
+        m_port->waitForReadyRead(qMin(remaining, (int)CancelToken::POLL_SLICE_MS));
+    }
+    if (m_port->bytesAvailable() < len) {
+        return false;
+    }
+    if (m_port->read(response, len) != len) {
+        return false;
+    }
+    if (m_sendCount > 0) {
+        m_roundTrips.append(m_linkClock.nsecsElapsed() - m_sendTimes[m_sendHead]);
+        m_sendHead = (m_sendHead + 1) % SEND_TIMES;
+        --m_sendCount;
+    }
+    if (m_trace) {
+        m_trace->record(TraceRecorder::RX, (const uint8_t *)response, len);
+    }
+    return true;
 }
 
+void UARTBootloader::queryCapabilities()
+{
+    //Stock Harmony bootloaders answer READ_CAPS with BL_RESP_INVALID.
+    //Only use compressed blocks when the target says it can decode them.
+    char result = 0;
+    uint32_t dummy = 0;
+    m_lzSupported = false;
+    m_pipelineSupported = false;
+    if (!m_compressionEnabled && !isNetwork()) {
+        return;
+    }
+    send<ReadVersion>(dummy);
+    ReadVersion::DataType version;
+    if (!readResponse(&result, 1, 200) || result != BL_RESP_OK || !readData<ReadVersion>(version, 200)) {
+        return;
+    }
+    send<ReadCaps>(dummy);
+    ReadCaps::DataType caps = 0;
+    if (!readResponse(&result, 1, 200) || result != BL_RESP_OK || !readData<ReadCaps>(caps, 200)) {
+        return;
+    }
+    m_lzSupported = m_compressionEnabled && (caps & BL_CAP_DATA_LZ) != 0;
+    m_pipelineSupported = (caps & BL_CAP_PIPELINE) != 0;
+    emit message(QString("Bootloader version %1.%2%3").arg(version[0]).arg(version[1])
+                 .arg(m_lzSupported ? ", compressed data enabled" : ""));
+}
+
+double UARTBootloader::medianMs(QVector<qint64> samples)
+{
+    if (samples.isEmpty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2] / 1e6;
+}
+
+int UARTBootloader::resumeBlock()
+{
+    QMutexLocker lock(&s_checkpointMutex);
+    if (!s_checkpoints.contains(m_portName)) {
+        return 0;
+    }
+    const Checkpoint &checkpoint = s_checkpoints[m_portName];
+    if (checkpoint.flashStart != m_flashStart || checkpoint.flashLen != (uint32_t)m_flashData.size()
+            || checkpoint.crc != m_flashCRC || checkpoint.eraseBlockSize != m_eraseBlockSize) {
+        //Different image or layout, start from the beginning
+        s_checkpoints.remove(m_portName);
+        return 0;
+    }
+    return checkpoint.nextBlock;
+}
+
+void UARTBootloader::saveCheckpoint(int nextBlock)
+{
+    QMutexLocker lock(&s_checkpointMutex);
+    Checkpoint checkpoint = {m_flashStart, (uint32_t)m_flashData.size(), m_flashCRC, m_eraseBlockSize, nextBlock};
+    s_checkpoints.insert(m_portName, checkpoint);
+}
+
+void UARTBootloader::clearCheckpoint()
+{
+    QMutexLocker lock(&s_checkpointMutex);
+    s_checkpoints.remove(m_portName);
+}
+
+uint32_t UARTBootloader::generateCRC()
+{
+    return pagedCRC32(m_flashData, m_eraseBlockSize);
+}
@@ -3,7 +3,11 @@
 
 #include "bootloader.h"
 #include <QtSerialPort/QSerialPort>
-#include <QFile>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QElapsedTimer>
 
 typedef union {
     struct __attribute__ ((packed)){
@@ -23,20 +27,93 @@ public:
     virtual bool programFlash() override;
     virtual void jumpToApp() override;
     virtual bool verify() override;
+    void setCompression(bool enable) {m_compressionEnabled = enable;}
+    void setTransport(QIODevice *transport) {m_transport.reset(transport);}
+    void setNativeSerial(bool enable) {m_nativeSerial = enable;}
+    //Leave the port open after jumpToApp() so the next job starts without
+    //opening it again (the daemon, where the next board follows on the same port)
+    void setKeepOpen(bool enable) {m_keepOpen = enable;}
+    virtual double roundTripMs() override {return m_commandRttMs;}
 private:
-    enum {BL_CMD_UNLOCK= 0xa0, BL_CMD_DATA = 0xa1, BL_CMD_VERIFY = 0xa2, BL_CMD_RESET = 0xa3};
+    friend class UARTSimulator;
+    enum {BL_CMD_UNLOCK= 0xa0, BL_CMD_DATA = 0xa1, BL_CMD_VERIFY = 0xa2, BL_CMD_RESET = 0xa3,
+          BL_CMD_READ_VERSION = 0xa6, BL_CMD_READ_CAPS = 0xa8, BL_CMD_DATA_LZ = 0xa9};
     enum {BL_RESP_OK = 0x50, BL_RESP_ERROR = 0x51, BL_RESP_INVALID = 0x52, BL_RESP_CRC_OK = 0x53,
           BL_RESP_CRC_FAIL = 0x54};
-    const uint32_t BTL_GUARD = 0x5048434D;
+    enum {BL_CAP_DATA_LZ = 0x01, BL_CAP_PIPELINE = 0x02};
+    //Fixed size commands.  The payload type sets the bytes sent and Data the
+    //bytes that follow BL_RESP_OK, so neither is counted by hand.
+    struct NoData {};
+    template<uint8_t Code, class Payload, class Data = NoData>
+    struct Command
+    {
+        static constexpr uint8_t code = Code;
+        typedef Payload PayloadType;
+        typedef Data DataType;
+    };
+    typedef Command<BL_CMD_UNLOCK, uint32_t[2]> Unlock;         //start, length
+    typedef Command<BL_CMD_VERIFY, uint32_t> Verify;            //crc32
+    typedef Command<BL_CMD_RESET, uint8_t> Reset;               //dummy byte
+    typedef Command<BL_CMD_READ_VERSION, uint32_t, uint8_t[2]> ReadVersion;
+    typedef Command<BL_CMD_READ_CAPS, uint32_t, uint32_t> ReadCaps;
+    template<class Cmd>
+    void send(const typename Cmd::PayloadType &payload) {sendCommand(Cmd::code, (const char *)&payload, sizeof(payload));}
+    template<class Cmd>
+    bool readData(typename Cmd::DataType &data, int wait_ms) {return readResponse((char *)&data, sizeof(data), wait_ms);}
+    //DATA carries the address and one erase block, which is at most 64K
+    enum {MAX_BLOCK_WORDS = 0x10000 / 4};
+    uint32_t m_blockData[MAX_BLOCK_WORDS + 1];
+    uint32_t m_blockPacked[MAX_BLOCK_WORDS + 1];
+    //Blocks in flight over a network link, limited by the socket buffer
+    enum {MAX_WINDOW = 8, SOCKET_BUFFER = 65536, TCP_CONNECT_TIMEOUT = 3000};
+    static const uint32_t BTL_GUARD = 0x5048434D;
     QString m_portName;
     int m_baud;
     bool m_connected;
-    std::unique_ptr<QFile> m_binFile;
+    QByteArray m_flashData;
     uint32_t m_flashStart;
     uint16_t m_eraseBlockSize;
     TxHeader m_txHeader;
-    std::unique_ptr<QSerialPort> m_port;
-    uint32_t generateCRC(uint32_t &flashLen);
+    std::unique_ptr<QIODevice> m_port;
+    std::unique_ptr<QIODevice> m_transport;
+    bool m_compressionEnabled;
+    bool m_lzSupported;
+    bool m_pipelineSupported;
+    bool m_nativeSerial;
+    bool m_keepOpen;
+    double m_commandRttMs;
+    //Time from the end of each command to its first response byte.  Replies
+    //come back in order, so the oldest send time matches the next reply.
+    //No more than the window is ever waiting, so a fixed ring holds them.
+    QElapsedTimer m_linkClock;
+    enum {SEND_TIMES = 2 * MAX_WINDOW};
+    qint64 m_sendTimes[SEND_TIMES];
+    int m_sendHead;
+    int m_sendCount;
+    QVector<qint64> m_roundTrips;
+    bool isNetwork() const {return m_portName.startsWith("tcp://");}
+    bool sendBlock(int block);
+    static double medianMs(QVector<qint64> samples);
+    bool openPort();
+    bool isPortOpen() const;
+    void flushPort();
+    void sendCommand(uint8_t command, const char *payload, uint32_t size);
+    bool readResponse(char *response, int len, int wait_ms = 1000);
+    void queryCapabilities();
+    uint32_t generateCRC();
+    typedef struct {
+        uint32_t flashStart;
+        uint32_t flashLen;
+        uint32_t crc;
+        uint16_t eraseBlockSize;
+        int nextBlock;
+    } Checkpoint;
+    //Last acknowledged block per port, kept across reconnects
+    static QHash<QString, Checkpoint> s_checkpoints;
+    static QMutex s_checkpointMutex;
+    int resumeBlock();
+    void saveCheckpoint(int nextBlock);
+    void clearCheckpoint();
     uint32_t m_flashCRC;
 };
 
@@ -0,0 +1,159 @@
+#include "uartsimulator.h"
+#include "uartbootloader.h"
+#include "lzblock.h"
+#include "crc.h"
+#include "allocationcounter.h"
+
+UARTSimulator::UARTSimulator(uint16_t eraseBlockSize, bool lzSupported) :
+    QIODevice(), m_eraseBlockSize(eraseBlockSize), m_lzSupported(lzSupported),
+    m_unlocked(false), m_flashStart(0), m_bytesReceived(0), m_bytesSent(0)
+{
+
+}
+
+qint64 UARTSimulator::bytesAvailable() const
+{
+    return m_txBuffer.size() + QIODevice::bytesAvailable();
+}
+
+bool UARTSimulator::waitForReadyRead(int msecs)
+{
+    (void) msecs;
+    return !m_txBuffer.isEmpty();
+}
+
+bool UARTSimulator::waitForBytesWritten(int msecs)
+{
+    (void) msecs;
+    return true;
+}
+
+qint64 UARTSimulator::readData(char *data, qint64 maxSize)
+{
+    //Device side, not part of the host transfer loop being checked
+    AllocationExempt device;
+    qint64 len = qMin(maxSize, (qint64)m_txBuffer.size());
+    memcpy(data, m_txBuffer.constData(), len);
+    m_txBuffer.remove(0, len);
+    m_bytesSent += len;
+    return len;
+}
+
+qint64 UARTSimulator::writeData(const char *data, qint64 maxSize)
+{
+    AllocationExempt device;
+    m_rxBuffer.append(data, maxSize);
+    m_bytesReceived += maxSize;
+    while (m_rxBuffer.size() >= HEADER_SIZE) {
+        uint32_t guard = *(uint32_t *)m_rxBuffer.constData();
+        uint32_t size = *(uint32_t *)(m_rxBuffer.constData() + 4);
+        uint8_t command = m_rxBuffer[8];
+        //No command is longer than DATA, a larger size is not waited for
+        if (guard != UARTBootloader::BTL_GUARD || size > qMax(8u, m_eraseBlockSize + 4u)) {
+            m_rxBuffer.clear();
+            respond(UARTBootloader::BL_RESP_ERROR);
+            break;
+        }
+        if ((uint32_t)m_rxBuffer.size() < HEADER_SIZE + size) {
+            break;
+        }
+        processCommand(command, m_rxBuffer.mid(HEADER_SIZE, size));
+        m_rxBuffer.remove(0, HEADER_SIZE + size);
+    }
+    return maxSize;
+}
+
+void UARTSimulator::processCommand(uint8_t command, const QByteArray &payload)
+{
+    const uint8_t *p = (const uint8_t *)payload.constData();
+    switch (command) {
+    case UARTBootloader::BL_CMD_UNLOCK: {
+        if (payload.size() != 8) {
+            respond(UARTBootloader::BL_RESP_ERROR);
+            return;
+        }
+        uint32_t size = *(uint32_t *)&p[4];
+        if (size == 0 || size > MAX_FLASH_SIZE || size % m_eraseBlockSize) {
+            respond(UARTBootloader::BL_RESP_ERROR);
+            return;
+        }
+        //Like the real target UNLOCK does not erase, pages are erased by DATA
+        if (m_flashStart != *(uint32_t *)&p[0] || (uint32_t)m_flash.size() != size) {
+            m_flashStart = *(uint32_t *)&p[0];
+            m_flash.fill(0xff, size);
+        }
+        m_unlocked = true;
+        respond(UARTBootloader::BL_RESP_OK);
+        return;
+    }
+    case UARTBootloader::BL_CMD_DATA:
+        if (payload.size() != m_eraseBlockSize + 4) {
+            respond(UARTBootloader::BL_RESP_ERROR);
+            return;
+        }
+        respond(programPage(*(uint32_t *)p, &p[4]) ? UARTBootloader::BL_RESP_OK
+                                                   : UARTBootloader::BL_RESP_ERROR);
+        return;
+    case UARTBootloader::BL_CMD_DATA_LZ: {
+        QByteArray page(m_eraseBlockSize, 0);
+        if (!m_lzSupported || payload.size() < 5) {
+            respond(UARTBootloader::BL_RESP_INVALID);
+            return;
+        }
+        int len = LZBlock::decompress(&p[4], payload.size() - 4, (uint8_t *)page.data(), page.size());
+        if (len != m_eraseBlockSize) {
+            respond(UARTBootloader::BL_RESP_ERROR);
+            return;
+        }
+        respond(programPage(*(uint32_t *)p, (const uint8_t *)page.constData())
+                ? UARTBootloader::BL_RESP_OK : UARTBootloader::BL_RESP_ERROR);
+        return;
+    }
+    case UARTBootloader::BL_CMD_VERIFY:
+        if (payload.size() != 4 || !m_unlocked) {
+            respond(UARTBootloader::BL_RESP_ERROR);
+            return;
+        }
+        respond(CRC::crc32((const uint8_t *)m_flash.constData(), m_flash.size())
+                == *(uint32_t *)p ? UARTBootloader::BL_RESP_CRC_OK : UARTBootloader::BL_RESP_CRC_FAIL);
+        return;
+    case UARTBootloader::BL_CMD_RESET:
+        m_unlocked = false;
+        respond(UARTBootloader::BL_RESP_OK);
+        return;
+    case UARTBootloader::BL_CMD_READ_VERSION:
+        respond(UARTBootloader::BL_RESP_OK);
+        m_txBuffer.append((char)(VERSION >> 8));
+        m_txBuffer.append((char)(VERSION & 0xff));
+        return;
+    case UARTBootloader::BL_CMD_READ_CAPS: {
+        if (!m_lzSupported) {
+            respond(UARTBootloader::BL_RESP_INVALID);
+            return;
+        }
+        //Commands are buffered whole, so pipelined blocks are safe
+        uint32_t caps = UARTBootloader::BL_CAP_DATA_LZ | UARTBootloader::BL_CAP_PIPELINE;
+        respond(UARTBootloader::BL_RESP_OK);
+        m_txBuffer.append((const char *)&caps, 4);
+        return;
+    }
+    default:
+        respond(UARTBootloader::BL_RESP_INVALID);
+        return;
+    }
+}
+
+bool UARTSimulator::programPage(uint32_t address, const uint8_t *page)
+{
+    if (!m_unlocked || address < m_flashStart || (address - m_flashStart) % m_eraseBlockSize
+            || address - m_flashStart + m_eraseBlockSize > (uint32_t)m_flash.size()) {
+        return false;
+    }
+    memcpy(m_flash.data() + (address - m_flashStart), page, m_eraseBlockSize);
+    return true;
+}
+
+void UARTSimulator::respond(uint8_t response)
+{
+    m_txBuffer.append((char)response);
+}
@@ -0,0 +1,43 @@
+#ifndef UARTSIMULATOR_H
+#define UARTSIMULATOR_H
+
+#include <QIODevice>
+#include <QByteArray>
+
+//In-process stand-in for a Harmony UART bootloader target.  It implements the
+//target side of the protocol, including the DATA_LZ extension, so the host
+//code can be exercised end to end without hardware.
+class UARTSimulator : public QIODevice
+{
+public:
+    UARTSimulator(uint16_t eraseBlockSize, bool lzSupported = true);
+    static QString portName() {return "Simulator";}
+    virtual bool isSequential() const override {return true;}
+    virtual qint64 bytesAvailable() const override;
+    virtual bool waitForReadyRead(int msecs) override;
+    virtual bool waitForBytesWritten(int msecs) override;
+    const QByteArray &flash() const {return m_flash;}
+    uint32_t flashStart() const {return m_flashStart;}
+    //Bytes seen on the line in each direction, for link timing models
+    qint64 bytesReceived() const {return m_bytesReceived;}
+    qint64 bytesSent() const {return m_bytesSent;}
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize) override;
+    virtual qint64 writeData(const char *data, qint64 maxSize) override;
+private:
+    enum {HEADER_SIZE = 9, VERSION = 0x0301, MAX_FLASH_SIZE = 0x200000};
+    uint16_t m_eraseBlockSize;
+    bool m_lzSupported;
+    bool m_unlocked;
+    uint32_t m_flashStart;
+    QByteArray m_flash;
+    QByteArray m_rxBuffer;
+    QByteArray m_txBuffer;
+    qint64 m_bytesReceived;
+    qint64 m_bytesSent;
+    void processCommand(uint8_t command, const QByteArray &payload);
+    bool programPage(uint32_t address, const uint8_t *page);
+    void respond(uint8_t response);
+};
+
+#endif // UARTSIMULATOR_H
@@ -1,24 +1,98 @@
 #include "workerthread.h"
+#include <QElapsedTimer>
+#include <QSettings>
 
-WorkerThread::WorkerThread(Bootloader *boot) : QThread(), bootloader(boot)
+WorkerThread::WorkerThread(Bootloader *boot) : QThread(), bootloader(boot),
+    m_verifyFirst(false), m_realtime(false), m_realtimeCore(-1),
+    m_stats{0, 0, 0, 0, 0, 0, -1, false, false, false, QString()}
 {
 
 }
 
 
 void WorkerThread::run()
+{
+    if (m_realtime) {
+        //What it buys in wakeup latency is measured by --benchmark, a
+        //probe here would add its sleeps to every job
+        m_stats.realtime = true;
+        RealtimeScope scope(m_realtimeCore);
+        m_stats.realtimeApplied = scope.description();
+        runJob();
+    } else {
+        runJob();
+    }
+    m_stats.cancelMs = bootloader->cancelToken().msSinceCancel();
+    if (m_stats.cancelMs >= 0) {
+        //Usually cancelled from closeEvent, so keep it where it can be seen later
+        QSettings().setValue("last_cancel_ms", m_stats.cancelMs);
+    }
+}
+
+void WorkerThread::runJob()
 {
     bool success;
+    QElapsedTimer total;
+    QElapsedTimer phase;
+    QSettings settings;
+    total.start();
+    if (m_verifyFirst) {
+        phase.start();
+        emit bootloader->phaseStarted("check");
+        bool upToDate = bootloader->isUpToDate();
+        m_stats.checkMs = phase.elapsed();
+        if (upToDate) {
+            m_stats.upToDate = true;
+            m_stats.success = true;
+            //Saving is measured against the last full erase/program/verify
+            qint64 lastFullMs = settings.value("last_full_job_ms", 0).toLongLong();
+            m_stats.savedMs = lastFullMs > m_stats.checkMs ? lastFullMs - m_stats.checkMs : 0;
+            emit bootloader->message("Device already up to date");
+            bootloader->jumpToApp();
+            m_stats.totalMs = total.elapsed();
+            emit bootloader->finished(true);
+            return;
+        }
+    }
+    phase.start();
+    emit bootloader->phaseStarted("erase");
     success = bootloader->eraseFlash();
+    m_stats.eraseMs = phase.elapsed();
     if (!success || bootloader->isAborted()) {
         return;
     }
+    phase.start();
+    emit bootloader->phaseStarted("program");
     success = bootloader->programFlash();
+    m_stats.programMs = phase.elapsed();
     if (!success || bootloader->isAborted()) {
         return;
     }
+    phase.start();
+    emit bootloader->phaseStarted("verify");
     success = bootloader->verify();
+    m_stats.verifyMs = phase.elapsed();
     if (success) {
+        m_stats.success = true;
+        settings.setValue("last_full_job_ms", m_stats.eraseMs + m_stats.programMs + m_stats.verifyMs);
         bootloader->jumpToApp();
     }
+    m_stats.totalMs = total.elapsed();
+}
+
+QString WorkerThread::statsSummary() const
+{
+    if (m_stats.cancelMs >= 0) {
+        return QString("Cancelled, stopped %1 ms after the request").arg(m_stats.cancelMs);
+    }
+    QString realtime;
+    if (m_stats.realtime) {
+        realtime = QString(", real-time: %1").arg(m_stats.realtimeApplied);
+    }
+    if (m_stats.upToDate) {
+        return QString("Already up to date, checked in %1 ms, saved about %2 s%3")
+                .arg(m_stats.checkMs).arg(m_stats.savedMs / 1000.0, 0, 'f', 1).arg(realtime);
+    }
+    return QString("%1 ms (erase %2, program %3, verify %4)%5").arg(m_stats.totalMs)
+            .arg(m_stats.eraseMs).arg(m_stats.programMs).arg(m_stats.verifyMs).arg(realtime);
 }
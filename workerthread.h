@@ -3,16 +3,41 @@
 
 #include <QThread>
 #include "bootloader.h"
+#include "realtime.h"
+
+typedef struct {
+    qint64 checkMs;
+    qint64 eraseMs;
+    qint64 programMs;
+    qint64 verifyMs;
+    qint64 totalMs;
+    qint64 savedMs;     //estimated time not spent because the device was up to date
+    qint64 cancelMs;    //from abort() to the job returning, -1 if not cancelled
+    bool upToDate;
+    bool success;       //verified or already up to date
+    bool realtime;
+    QString realtimeApplied;
+} JobStats;
 
 class WorkerThread : public QThread
 {
 public:
     explicit WorkerThread(Bootloader *boot);
+    void setVerifyFirst(bool verifyFirst) {m_verifyFirst = verifyFirst;}
+    //Run the transfers with real-time priority, core < 0 for any core
+    void setRealtime(bool enable, int core = -1) {m_realtime = enable; m_realtimeCore = core;}
+    const JobStats &stats() const {return m_stats;}
+    QString statsSummary() const;
 
 protected:
     virtual void run() override;
 private:
+    void runJob();
     Bootloader *bootloader;
+    bool m_verifyFirst;
+    bool m_realtime;
+    int m_realtimeCore;
+    JobStats m_stats;
 };
 
 #endif // WORKERTHREAD_H